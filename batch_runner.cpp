@@ -0,0 +1,105 @@
+#include "batch_runner.hpp"
+#include "thread_pool.hpp"
+#include "cycle_detector.hpp"
+#include "translation_detector.hpp"
+#include "lockstep_runner.hpp"
+
+// inputs handed to a task at once, small enough to keep all the workers busy
+// till the end and large enough to amortize the tape allocation
+const long batch_runner::CHUNK_SIZE = 64;
+const long batch_runner::INTERRUPT_CHECK_INTERVAL = 1 << 16;
+
+batch_runner::batch_runner(const transition_table &table, tape_mode mode, long memory_size, char blank, long head,
+	uint32_t init_state)
+	: table(table), mode(mode), memory_size(memory_size), blank(blank), head(head), init_state(init_state)
+{
+}
+
+void batch_runner::set_cycle_check(bool enabled)
+{
+	check_cycles = enabled;
+}
+
+void batch_runner::set_translation_check(bool enabled)
+{
+	check_translations = enabled;
+}
+
+std::vector<batch_result> batch_runner::run(const std::vector<std::string> &inputs, long max_steps, int window,
+	unsigned threads, const std::atomic<bool> *interrupt) const
+{
+	std::vector<batch_result> results(inputs.size());
+	thread_pool pool(threads);
+
+	// the detectors follow a single tape, so only plain runs on fixed tapes go in lockstep
+	if (mode == tape_mode::fixed && !check_cycles && !check_translations && lockstep_runner::fits(memory_size)) {
+		lockstep_runner lockstep(table, memory_size, blank, head, init_state);
+		for (size_t first = 0; first < inputs.size(); first += CHUNK_SIZE) {
+			size_t last = std::min(inputs.size(), first + CHUNK_SIZE);
+			pool.submit([&lockstep, &inputs, &results, first, last, max_steps, window, interrupt] {
+				lockstep.run(inputs, first, last, max_steps, window, interrupt, results);
+			});
+		}
+		pool.wait();
+		return results;
+	}
+
+	for (size_t first = 0; first < inputs.size(); first += CHUNK_SIZE) {
+		size_t last = std::min(inputs.size(), first + CHUNK_SIZE);
+
+		// every task writes its own slice of results, so they come out in input order
+		pool.submit([this, &inputs, &results, first, last, max_steps, window, interrupt] {
+			std::unique_ptr<tape_storage> tape(tape_storage::create(mode, memory_size, blank));
+			for (size_t i = first; i < last; i++)
+				results[i] = run_one(*tape, inputs[i], max_steps, window, interrupt);
+		});
+	}
+
+	pool.wait();
+	return results;
+}
+
+batch_result batch_runner::run_one(tape_storage &tape, const std::string &input, long max_steps, int window,
+	const std::atomic<bool> *interrupt) const
+{
+	batch_result result = { run_status::step_limit, init_state, 0, "" };
+	long pos = head;
+
+	tape.clear(blank);
+	for (size_t i = 0; i < input.size(); i++)
+		tape.set(head + i, input[i]);
+
+	std::unique_ptr<cycle_detector> detector;
+	std::unique_ptr<translation_detector> translation;
+	if (check_cycles)
+		detector.reset(new cycle_detector(table, tape, pos, result.state));
+	if (check_translations)
+		translation.reset(new translation_detector(table, tape, pos));
+
+	while (max_steps < 0 || result.steps < max_steps) {
+		if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+			result.status = run_status::interrupted;
+			break;
+		}
+
+		long n = INTERRUPT_CHECK_INTERVAL;
+		if (max_steps >= 0 && max_steps - result.steps < n)
+			n = max_steps - result.steps;
+
+		if (detector)
+			result.steps += detector->run(tape, pos, result.state, n, result.status, translation.get());
+		else if (translation)
+			result.steps += translation->run(tape, pos, result.state, n, result.status);
+		else
+			result.steps += run_segments(table, tape, pos, result.state, n, result.status);
+		if (result.status != run_status::step_limit)
+			break;
+	}
+
+	long begin = std::max(pos - window, tape.get_begin());
+	long end = std::min(pos + window + 1, tape.get_end());
+	if (begin < end)
+		result.window = tape.read(begin, end);
+
+	return result;
+}
@@ -0,0 +1,53 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+
+struct batch_result {
+	run_status status;
+	uint32_t state;
+	long steps;
+	std::string window;	// tape cells around the final head position
+};
+
+/*
+ * Runs one program against many initial tapes on a work stealing thread pool.
+ * The execution table is shared read only by all the workers, each task owns
+ * a private tape reused for all of its inputs.
+ */
+class batch_runner {
+	static const long CHUNK_SIZE;
+	static const long INTERRUPT_CHECK_INTERVAL;
+
+	const transition_table& table;
+	tape_mode mode;
+	long memory_size;
+	char blank;
+	long head;
+	uint32_t init_state;
+	bool check_cycles = false;
+	bool check_translations = false;
+
+public:
+	batch_runner(const transition_table& table, tape_mode mode, long memory_size, char blank, long head,
+		uint32_t init_state);
+
+	// stop the inputs whose configuration repeats with run_status::cycling
+	void set_cycle_check(bool enabled);
+	// stop the inputs proven to drift forever with run_status::translated
+	void set_translation_check(bool enabled);
+
+	// each input is written on the tape starting at the head position
+	std::vector<batch_result> run(const std::vector<std::string>& inputs, long max_steps, int window,
+		unsigned threads, const std::atomic<bool> *interrupt = nullptr) const;
+
+	batch_result run_one(tape_storage& tape, const std::string& input, long max_steps, int window,
+		const std::atomic<bool> *interrupt) const;
+};
+
+#endif
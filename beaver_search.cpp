@@ -0,0 +1,164 @@
+#include "beaver_search.hpp"
+#include "tape_storage.hpp"
+#include "thread_pool.hpp"
+#include "cycle_detector.hpp"
+
+#include <stdexcept>
+
+// machines with fewer transitions than this are explored by their own task
+const int beaver_search::SPLIT_DEPTH = 3;
+const long beaver_search::INTERRUPT_CHECK_INTERVAL = 1 << 16;
+
+static const int HALT_STATE = 0;
+static const int INIT_STATE = 1;
+
+beaver_search::beaver_search(int states, int symbols, long max_steps)
+	: states(states), symbols(symbols), max_steps(max_steps)
+{
+	if (states < 1 || states > 26 || symbols < 2 || symbols > 10)
+		throw std::runtime_error("Invalid machine size");
+	if (max_steps < 1)
+		throw std::runtime_error("Invalid step limit");
+}
+
+beaver_report beaver_search::run(unsigned threads, const std::atomic<bool> *interrupt)
+{
+	this->interrupt = interrupt;
+	report = beaver_report();
+
+	thread_pool pool(threads);
+	node root = { {}, 1, 1 };
+	pool.submit([this, &pool, root] {
+		beaver_report local;
+		explore(pool, root, local);
+		merge(local);
+	});
+	pool.wait();
+
+	return report;
+}
+
+void beaver_search::merge(const beaver_report &local)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	report.machines += local.machines;
+	report.halting += local.halting;
+	report.cycling += local.cycling;
+	report.holdouts += local.holdouts;
+	report.holdout_machines.insert(report.holdout_machines.end(),
+		local.holdout_machines.begin(), local.holdout_machines.end());
+	report.interrupted |= local.interrupted;
+	if (local.best_steps > report.best_steps) {
+		report.best_steps = local.best_steps;
+		report.champion = local.champion;
+	}
+}
+
+void beaver_search::explore(thread_pool &pool, const node &n, beaver_report &local)
+{
+	if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+		local.interrupted = true;
+		return;
+	}
+
+	// the simulation restarts from the blank tape: the prefix already run by
+	// the parent is short compared to copying the tape into every child
+	transition_table table(n.program, states + 1, HALT_STATE);
+	unbounded_tape tape(64, symbol(0));
+	long head = 0;
+	uint32_t state = INIT_STATE;
+	long steps = 0;
+	run_status status = run_status::step_limit;
+	cycle_detector detector(table, tape, head, state);
+	translation_detector translation(table, tape, head);
+
+	local.machines++;
+	while (steps < max_steps) {
+		steps += detector.run(tape, head, state, std::min(INTERRUPT_CHECK_INTERVAL, max_steps - steps), status,
+			&translation);
+		if (status != run_status::step_limit)
+			break;
+		if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+			local.interrupted = true;
+			return;
+		}
+	}
+
+	if (status == run_status::cycling || status == run_status::translated) {
+		local.cycling++;
+		return;
+	}
+
+	if (status != run_status::illegal_instruction) {
+		local.holdouts++;
+		local.holdout_machines.push_back(format(n.program));
+		return;
+	}
+
+	// halting on the missing transition, the step counted for the illegal
+	// instruction is the halting step
+	char read = tape.get(head);
+	instruction halt = { static_cast<int>(state), read, HALT_STATE, symbol(1), direction::R };
+	local.halting++;
+	if (steps > local.best_steps) {
+		std::vector<instruction> program = n.program;
+		program.push_back(halt);
+		local.best_steps = steps;
+		local.champion = format(program);
+	}
+
+	// a machine without any halting transition can't halt
+	if (static_cast<int>(n.program.size()) + 1 >= states * symbols)
+		return;
+
+	int max_symbol = std::min(n.used_symbols, symbols - 1);
+	int max_state = std::min(n.used_states + 1, states);
+	for (int w = 0; w <= max_symbol; w++) {
+		for (int d = 0; d < 2; d++) {
+			direction dir = d == 0 ? direction::R : direction::L;
+			if (dir == direction::L && n.program.empty())
+				continue;
+
+			for (int s = INIT_STATE; s <= max_state; s++) {
+				node child = n;
+				child.program.push_back({ static_cast<int>(state), read, s, symbol(w), dir });
+				child.used_states = std::max(n.used_states, s);
+				child.used_symbols = std::max(n.used_symbols, w + 1);
+
+				if (static_cast<int>(child.program.size()) < SPLIT_DEPTH) {
+					pool.submit([this, &pool, child] {
+						beaver_report task;
+						explore(pool, child, task);
+						merge(task);
+					});
+				} else {
+					explore(pool, child, local);
+				}
+			}
+		}
+	}
+}
+
+std::string beaver_search::format(const std::vector<instruction> &program) const
+{
+	std::string result;
+	for (int s = INIT_STATE; s <= states; s++) {
+		if (s != INIT_STATE)
+			result += '_';
+		for (int c = 0; c < symbols; c++) {
+			const instruction *found = nullptr;
+			for (const instruction &i : program)
+				if (i.from_state == s && i.symbol_read == symbol(c))
+					found = &i;
+
+			if (found == nullptr) {
+				result += "---";
+				continue;
+			}
+			result += found->symbol_write;
+			result += found->tape_direction == direction::L ? 'L' : 'R';
+			result += found->to_state == HALT_STATE ? 'Z' : static_cast<char>('A' + found->to_state - INIT_STATE);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,74 @@
+#ifndef BEAVER_SEARCH_H
+#define BEAVER_SEARCH_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "transition_table.hpp"
+
+class thread_pool;
+
+struct beaver_report {
+	long machines = 0;	// machines simulated
+	long halting = 0;	// halting machines found
+	long cycling = 0;	// machines proven not to halt by a (translated) cycle
+	long holdouts = 0;	// machines still running at the step limit
+	long best_steps = 0;
+	std::string champion;	// halting machine running the most steps
+	std::vector<std::string> holdout_machines;
+	bool interrupted = false;
+};
+
+/*
+ * Busy beaver enumeration in tree normal form: a machine starts with no
+ * transitions and is simulated until it needs an undefined one, then it is
+ * extended with every possible choice for that transition (or halted there).
+ *
+ * Equivalent machines are generated only once: the first move always goes
+ * right (mirror symmetry), a transition can only go to the states already
+ * reached plus the first unused one and write the symbols already written
+ * plus the first unused one (state and symbol permutations).
+ *
+ * Machines repeating a configuration, in place or shifted, are dropped as
+ * soon as the repeat is found, only the undecided ones are left as holdouts.
+ *
+ * The subtrees near the root are tasks of a work stealing pool, so idle
+ * workers steal the largest pending subtrees, deeper nodes are explored
+ * depth first by the task that created them.
+ */
+class beaver_search {
+	static const int SPLIT_DEPTH;
+	static const long INTERRUPT_CHECK_INTERVAL;
+
+	struct node {
+		std::vector<instruction> program;
+		int used_states;	// states reached, starting from A
+		int used_symbols;	// symbols written, starting from the blank
+	};
+
+	int states;
+	int symbols;
+	long max_steps;
+	const std::atomic<bool> *interrupt = nullptr;
+
+	std::mutex lock;
+	beaver_report report;
+
+	void explore(thread_pool& pool, const node& n, beaver_report& local);
+	void merge(const beaver_report& local);
+
+public:
+	beaver_search(int states, int symbols, long max_steps);
+
+	beaver_report run(unsigned threads = 0, const std::atomic<bool> *interrupt = nullptr);
+
+	// standard text format: one group per state, one `write move next` triple
+	// per symbol, `Z` is the halt state and `---` an undefined transition
+	std::string format(const std::vector<instruction>& program) const;
+
+	static char symbol(int index) { return static_cast<char>('0' + index); }
+};
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * Throughput benchmark of the execution paths of the simulator.
+ *
+ * Every workload is a program file, either one of the examples or a
+ * generated one, and runs through every path: the table, threaded, rle and
+ * native engines, the macro machine and the batch runner. Each case runs in
+ * a child process, so the peak RSS reported is its own, for some warmup
+ * trials and then the measured ones. A trial loads the file and runs it till
+ * it stops or reaches the step budget, loading it again while it stops
+ * before the budget and the trial is shorter than MIN_TRIAL_SECONDS.
+ */
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "command_line.hpp"
+#include "turing_machine.hpp"
+
+static const int DEFAULT_TRIALS = 5;
+static const int DEFAULT_WARMUP = 1;
+static const long DEFAULT_STEPS = 20000000;
+static const int MAX_TRIALS = 64;
+static const double MIN_TRIAL_SECONDS = 0.2;
+
+// cells per block of the macro path
+static const int MACRO_BLOCK = 4;
+// copies of the initial tape run by the batch path, sharing the step budget
+static const int BATCH_INPUTS = 64;
+static const long BATCH_INPUT_SIZE = 64;
+
+// states of the generated large program
+static const int LARGE_STATES = 16384;
+// larger programs take minutes to build with the native engine
+static const size_t NATIVE_MAX_INSTRUCTIONS = 4096;
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct workload {
+	std::string name;
+	std::string path;
+};
+
+struct execution_path {
+	const char *name;
+	// readies the loaded machine, throws if the path can't run it
+	void (*prepare)(turing_machine& m);
+	// runs at most max_steps steps, returns the steps done
+	long (*run)(turing_machine& m, long max_steps);
+};
+
+// measures of one case, written raw by the child to its parent
+struct case_result {
+	int trials;
+	double ns_per_step[MAX_TRIALS];
+	double load_seconds[MAX_TRIALS];
+	long steps;	// of one run, the same for all of them
+	long peak_rss;	// KB, of the child alone and not of the compiler it runs
+	char error[256];
+};
+
+// the runs end halting, on an illegal instruction or out of memory all the
+// same, the steps done are measured anyway
+static long run_engine(turing_machine &m, long max_steps)
+{
+	long before = m.get_computation_steps();
+	m.run(max_steps);
+	return m.get_computation_steps() - before;
+}
+
+static long run_macro(turing_machine &m, long max_steps)
+{
+	long before = m.get_computation_steps();
+	m.run_macro(MACRO_BLOCK, max_steps);
+	return m.get_computation_steps() - before;
+}
+
+// multi-tape machines always run on their tuple table, whatever the engine
+static void set_single_tape_engine(turing_machine &m, engine_type engine)
+{
+	if (m.get_tape_count() > 1)
+		throw std::runtime_error("skipped, multi-tape machine");
+	m.set_engine(engine);
+}
+
+static void compile_native(turing_machine &m)
+{
+	if (m.get_program_size() > NATIVE_MAX_INSTRUCTIONS)
+		throw std::runtime_error("skipped, more than " + std::to_string(NATIVE_MAX_INSTRUCTIONS) + " instructions");
+	m.compile_native();
+}
+
+// every input is the tape from the head on, as loaded
+static long run_batch(turing_machine &m, long max_steps)
+{
+	long begin = m.get_head_pos();
+	long end = std::min(begin + BATCH_INPUT_SIZE, m.get_tape_begin() + m.get_tape_length());
+	std::vector<std::string> inputs(BATCH_INPUTS, begin < end ? m.get_tape_range(begin, end) : "");
+
+	long steps = 0;
+	for (const batch_result &r : m.run_inputs(inputs, std::max(max_steps / BATCH_INPUTS, 1L), 0))
+		steps += r.steps;
+	return steps;
+}
+
+static const execution_path PATHS[] = {
+	{"table", [](turing_machine &m) { m.set_engine(engine_type::table); }, run_engine},
+	{"threaded", [](turing_machine &m) { set_single_tape_engine(m, engine_type::threaded); }, run_engine},
+	{"rle", [](turing_machine &m) { set_single_tape_engine(m, engine_type::rle); }, run_engine},
+	{"native", compile_native, run_engine},
+	{"macro", [](turing_machine &) {}, run_macro},
+	{"batch", [](turing_machine &) {}, run_batch},
+};
+
+static double seconds_since(bench_clock::time_point start)
+{
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static double median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	size_t n = values.size();
+	return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+// one trial of a case, false if it ran no step at all
+static bool run_trial(const workload &w, const execution_path &p, long max_steps, long &run_steps,
+	double &ns_per_step, double &load_seconds)
+{
+	std::ostream discard(nullptr);
+	long steps = 0;
+	int loads = 0;
+	double run_seconds = 0, load_total = 0;
+	bench_clock::time_point start = bench_clock::now();
+
+	do {
+		turing_machine m;
+		bench_clock::time_point t = bench_clock::now();
+		load_file(w.path, m, discard);
+		load_total += seconds_since(t);
+		loads++;
+
+		p.prepare(m);
+		t = bench_clock::now();
+		long done = p.run(m, max_steps - steps);
+		run_seconds += seconds_since(t);
+		if (done == 0)
+			break;
+		if (steps == 0)
+			run_steps = done;
+		steps += done;
+	} while (steps < max_steps && seconds_since(start) < MIN_TRIAL_SECONDS);
+
+	ns_per_step = steps > 0 ? run_seconds * 1e9 / steps : 0;
+	load_seconds = load_total / loads;
+	return steps > 0;
+}
+
+static void run_case(const workload &w, const execution_path &p, long max_steps, int warmup, case_result &r)
+{
+	try {
+		double ns, load;
+		for (int i = 0; i < warmup; i++)
+			run_trial(w, p, max_steps, r.steps, ns, load);
+
+		for (int i = 0; i < r.trials; i++)
+			if (!run_trial(w, p, max_steps, r.steps, r.ns_per_step[i], r.load_seconds[i]))
+				throw std::runtime_error("The program runs no step");
+
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		r.peak_rss = usage.ru_maxrss;
+	} catch (const std::exception &e) {
+		std::snprintf(r.error, sizeof(r.error), "%s", e.what());
+	}
+}
+
+// runs the case in a child process
+static void measure_case(const workload &w, const execution_path &p, long max_steps, int warmup, case_result &r)
+{
+	int fd[2];
+	if (pipe(fd) != 0)
+		throw std::runtime_error("Cannot create pipe");
+
+	std::cout.flush();
+	pid_t pid = fork();
+	if (pid < 0)
+		throw std::runtime_error("Cannot fork");
+	if (pid == 0) {
+		close(fd[0]);
+		run_case(w, p, max_steps, warmup, r);
+		ssize_t written = write(fd[1], &r, sizeof(r));
+		_exit(written == static_cast<ssize_t>(sizeof(r)) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(fd[1]);
+	size_t got = 0;
+	char *data = reinterpret_cast<char *>(&r);
+	ssize_t n;
+	while (got < sizeof(r) && (n = read(fd[0], data + got, sizeof(r) - got)) > 0)
+		got += n;
+	close(fd[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		throw std::runtime_error("Cannot wait for the benchmark process");
+	if (got != sizeof(r))
+		std::snprintf(r.error, sizeof(r.error), "benchmark process died (status %d)", status);
+}
+
+static std::string write_workload(const std::string &dir, const std::string &name, const std::string &text)
+{
+	std::string path = dir + "/" + name + ".tm";
+	std::ofstream out(path);
+	out << text;
+	if (!out)
+		throw std::runtime_error("Error writing " + path);
+	return path;
+}
+
+// the example as a program file, without the run commands the paths replace
+static std::string strip_runs(const std::string &filename)
+{
+	std::ifstream in(filename);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + filename + " for reading");
+
+	std::string result, line;
+	while (std::getline(in, line)) {
+		std::istringstream words(line);
+		std::string command;
+		words >> command;
+		if (command != "run" && command != "r")
+			result += line + '\n';
+	}
+	return result;
+}
+
+// binary counter counting up forever from the middle of a fixed tape
+static std::string counter_program(const char *mode)
+{
+	std::ostringstream p;
+	p << "tape_mode " << mode << "\nmemsize 4096\ninitsymbol _\nhead_position 2048\n"
+		<< "+ $ _ r 1 >\n+ $ 0 r 1 >\n+ $ 1 $ 0 <\n"
+		<< "+ r 0 r 0 >\n+ r 1 r 1 >\n+ r _ $ _ <\n";
+	return p.str();
+}
+
+// the 5 states 2 symbols busy beaver champion, 47176870 steps
+static std::string beaver_program()
+{
+	return "tape_mode unbounded\ninitsymbol 0\n"
+		"+ $ 0 B 1 >\n+ $ 1 C 1 <\n+ B 0 C 1 >\n+ B 1 B 1 >\n+ C 0 D 1 >\n"
+		"+ C 1 E 0 <\n+ D 0 $ 1 <\n+ D 1 D 1 <\n+ E 0 ! 1 >\n+ E 1 $ 0 <\n";
+}
+
+// bounces between the ends of a block of 1s, growing it by a cell on each side
+static std::string sweep_program()
+{
+	return "tape_mode unbounded\ninitsymbol 0\n"
+		"+ $ 0 L 1 <\n+ $ 1 $ 1 >\n+ L 0 $ 1 >\n+ L 1 L 1 <\n";
+}
+
+// LARGE_STATES states on 4 symbols, each transition to a random state
+static std::string large_program()
+{
+	std::mt19937 random(1);
+	std::ostringstream p;
+	p << "memsize 1048576\ninitsymbol 0\nhead_position 524288\n+ $ 0 s0 0 >\n";
+	for (int s = 0; s < LARGE_STATES; s++)
+		for (int c = 0; c < 4; c++)
+			p << "+ s" << s << ' ' << c << " s" << random() % LARGE_STATES << ' ' << random() % 4 << ' '
+				<< (random() % 2 == 0 ? '<' : '>') << '\n';
+	return p.str();
+}
+
+// writes 1 2 1 2... to the right forever
+static std::string writer_program(const char *settings)
+{
+	return std::string(settings) + "initsymbol 0\n+ $ 0 a 1 >\n+ a 0 $ 2 >\n";
+}
+
+static std::vector<workload> make_workloads(const std::string &dir, const std::string &examples)
+{
+	std::vector<workload> result;
+
+	std::vector<std::string> names;
+	if (DIR *d = opendir(examples.c_str())) {
+		while (struct dirent *e = readdir(d)) {
+			std::string name = e->d_name;
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, ".tm") == 0)
+				names.push_back(name.substr(0, name.size() - 3));
+		}
+		closedir(d);
+	}
+	std::sort(names.begin(), names.end());
+	for (const std::string &name : names)
+		result.push_back({name, write_workload(dir, name, strip_runs(examples + "/" + name + ".tm"))});
+
+	result.push_back({"counter", write_workload(dir, "counter", counter_program("fixed"))});
+	result.push_back({"counter_packed", write_workload(dir, "counter_packed", counter_program("packed"))});
+	result.push_back({"beaver5", write_workload(dir, "beaver5", beaver_program())});
+	result.push_back({"sweep", write_workload(dir, "sweep", sweep_program())});
+	result.push_back({"large", write_workload(dir, "large", large_program())});
+	result.push_back({"tape", write_workload(dir, "tape", writer_program("tape_mode unbounded\n"))});
+	result.push_back({"tape_sparse", write_workload(dir, "tape_sparse",
+		writer_program("tape_mode sparse\nmemsize 4294967296\nhead_position 2147483648\n"))});
+	return result;
+}
+
+static bool selected(const std::string &list, const std::string &name)
+{
+	if (list.empty())
+		return true;
+	std::istringstream items(list);
+	std::string item;
+	while (std::getline(items, item, ','))
+		if (item == name)
+			return true;
+	return false;
+}
+
+static void usage(const char *name)
+{
+	std::cerr << "Usage: " << name << " [-t trials] [-w warmup] [-s steps] [-p paths] [-f workloads] [examples]\n"
+		<< "\t-t\tmeasured trials per case (default " << DEFAULT_TRIALS << ", at most " << MAX_TRIALS << ")\n"
+		<< "\t-w\twarmup trials per case (default " << DEFAULT_WARMUP << ")\n"
+		<< "\t-s\tstep budget of a trial (default " << DEFAULT_STEPS << ")\n"
+		<< "\t-p\tcomma separated paths to run: table, threaded, rle, native, macro, batch\n"
+		<< "\t-f\tcomma separated workloads to run\n"
+		<< "\texamples: directory of the example programs (default examples)" << std::endl;
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int trials = DEFAULT_TRIALS, warmup = DEFAULT_WARMUP;
+	long max_steps = DEFAULT_STEPS;
+	std::string paths, filter;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:w:s:p:f:h")) != -1) {
+		switch (opt) {
+		case 't': trials = std::atoi(optarg); break;
+		case 'w': warmup = std::atoi(optarg); break;
+		case 's': max_steps = std::atol(optarg); break;
+		case 'p': paths = optarg; break;
+		case 'f': filter = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (trials < 1 || trials > MAX_TRIALS || warmup < 0 || max_steps < 1 || optind + 1 < argc)
+		usage(argv[0]);
+	std::string examples = optind < argc ? argv[optind] : "examples";
+
+	const char *tmp = std::getenv("TMPDIR");
+	std::string dir = std::string(tmp != nullptr ? tmp : "/tmp") + "/tm-bench-XXXXXX";
+	if (mkdtemp(&dir[0]) == nullptr) {
+		std::cerr << "Cannot create " << dir << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	std::vector<workload> workloads;
+	try {
+		workloads = make_workloads(dir, examples);
+
+		std::printf("%d trials of at most %ld steps after %d warmup, medians over the trials\n\n",
+			trials, max_steps, warmup);
+		std::printf("%-16s %-9s %12s %9s %10s %7s %10s %9s\n", "workload", "path", "steps/run", "ns/step",
+			"Msteps/s", "spread", "load ms", "RSS MB");
+		for (const workload &w : workloads) {
+			if (!selected(filter, w.name))
+				continue;
+			for (const execution_path &p : PATHS) {
+				if (!selected(paths, p.name))
+					continue;
+
+				case_result r;
+				std::memset(&r, 0, sizeof(r));
+				r.trials = trials;
+				measure_case(w, p, max_steps, warmup, r);
+				if (r.error[0] != '\0') {
+					std::printf("%-16s %-9s %s\n", w.name.c_str(), p.name, r.error);
+					continue;
+				}
+
+				std::vector<double> ns(r.ns_per_step, r.ns_per_step + trials);
+				std::vector<double> load(r.load_seconds, r.load_seconds + trials);
+				double mid = median(ns);
+				double spread = (*std::max_element(ns.begin(), ns.end()) - *std::min_element(ns.begin(), ns.end()))
+					/ mid * 100;
+				std::printf("%-16s %-9s %12ld %9.3f %10.1f %6.1f%% %10.3f %9.1f\n", w.name.c_str(), p.name,
+					r.steps, mid, 1e3 / mid, spread, median(load) * 1e3, r.peak_rss / 1024.0);
+				std::fflush(stdout);
+			}
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		status = EXIT_FAILURE;
+	}
+
+	for (const workload &w : workloads)
+		unlink(w.path.c_str());
+	rmdir(dir.c_str());
+	return status;
+}
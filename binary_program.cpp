@@ -0,0 +1,338 @@
+#include "binary_program.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP
+#endif
+
+static const char MAGIC[4] = {'T', 'M', 'P', 'B'};
+static const uint32_t VERSION = 2;
+// the table starts on a cache line of the mapping
+static const size_t TABLE_ALIGNMENT = 64;
+
+struct image_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t source_hash;
+	int64_t memory_size;
+	uint8_t settings;
+	uint8_t mode;
+	char initial_symbol;
+	uint8_t row_shift;		// layout of the table, see transition_table
+	uint32_t states;
+	uint64_t names_offset;		// states names, each ended by '\0'
+	uint64_t names_size;
+	uint64_t program_offset;	// image_instruction records
+	uint64_t program_count;
+	uint64_t table_offset;		// states << row_shift transition_table cells
+	uint8_t columns[transition_table::SYMBOLS];
+};
+
+struct image_instruction {
+	int32_t from_state;
+	int32_t to_state;
+	char symbol_read;
+	char symbol_write;
+	uint8_t tape_direction;
+	uint8_t reserved;
+};
+
+// the symbols index the transition table, as when added by hand; '-' is one of them
+static bool is_symbol(char c)
+{
+	return static_cast<unsigned char>(c) < transition_table::SYMBOLS;
+}
+
+// whole file, mapped read only when possible
+class program_image {
+	const char *data = nullptr;
+	size_t size = 0;
+#ifndef HAS_MMAP
+	std::vector<char> buffer;
+#endif
+
+public:
+	program_image(const std::string& filename);
+	~program_image();
+	program_image(const program_image&) = delete;
+	program_image& operator=(const program_image&) = delete;
+
+	const image_header& header() const { return *reinterpret_cast<const image_header *>(data); }
+	const char *at(uint64_t offset) const { return data + offset; }
+	bool contains(uint64_t offset, uint64_t length) const { return offset <= size && length <= size - offset; }
+};
+
+program_image::program_image(const std::string &filename)
+{
+#ifdef HAS_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Error opening file " + filename + " for reading");
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (addr != MAP_FAILED) {
+			data = static_cast<const char *>(addr);
+			size = st.st_size;
+		}
+	}
+	close(fd);
+	if (data == nullptr)
+		throw std::runtime_error("Cannot map file " + filename);
+#else
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + filename + " for reading");
+	buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	data = buffer.data();
+	size = buffer.size();
+#endif
+
+	const image_header &h = header();
+	if (size < sizeof(image_header) || std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION)
+		throw std::runtime_error("Invalid compiled program " + filename);
+	if (h.states < 2 || h.states > transition_table::MAX_STATES || h.mode > static_cast<uint8_t>(tape_mode::packed)
+		|| !contains(h.names_offset, h.names_size)
+		|| h.program_count > size / sizeof(image_instruction)
+		|| !contains(h.program_offset, h.program_count * sizeof(image_instruction))
+		|| !is_symbol(h.initial_symbol) || h.row_shift > 7 || h.table_offset % TABLE_ALIGNMENT != 0
+		|| !contains(h.table_offset, (uint64_t(h.states) << h.row_shift) * sizeof(transition_table::cell)))
+		throw std::runtime_error("Invalid compiled program " + filename);
+	for (uint8_t c : h.columns)
+		if (c >> h.row_shift != 0)
+			throw std::runtime_error("Invalid compiled program " + filename);
+}
+
+program_image::~program_image()
+{
+#ifdef HAS_MMAP
+	munmap(const_cast<char *>(data), size);
+#endif
+}
+
+bool is_binary_program(const std::string &filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string binary_program_cache(const std::string &source)
+{
+	if (source.size() > 3 && source.compare(source.size() - 3, 3, ".tm") == 0)
+		return source + "b";
+	return source + ".tmb";
+}
+
+uint64_t hash_source(const std::string &filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + filename + " for reading");
+
+	// FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	char buffer[1 << 16];
+	while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+		for (std::streamsize i = 0; i < in.gcount(); i++) {
+			h ^= static_cast<unsigned char>(buffer[i]);
+			h *= 1099511628211ULL;
+		}
+	}
+	return h != 0 ? h : 1;
+}
+
+template <typename T>
+static void write_value(std::ostream &out, const T &value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void write_padding(std::ostream &out, uint64_t &offset, size_t alignment)
+{
+	static const char zeros[TABLE_ALIGNMENT] = {};
+	size_t n = (alignment - offset % alignment) % alignment;
+	out.write(zeros, n);
+	offset += n;
+}
+
+void save_binary_program(const std::string &filename, const turing_machine &tm, uint64_t source_hash,
+	unsigned settings)
+{
+	tm.check_single_tape("compiled programs");
+
+	transition_table table = tm.table_dirty
+		? transition_table(tm.program, tm.state_name.size(), turing_machine::HALT_STATE)
+		: tm.table;
+
+	image_header h = {};
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.source_hash = source_hash;
+	h.memory_size = tm.get_tape_length();
+	h.settings = settings;
+	h.mode = static_cast<uint8_t>(tm.mode);
+	h.initial_symbol = tm.initial_symbol;
+	h.row_shift = table.get_row_shift();
+	std::memcpy(h.columns, table.get_columns(), sizeof(h.columns));
+	h.states = tm.state_name.size();
+	h.names_offset = sizeof(image_header);
+	for (const std::string &name : tm.state_name)
+		h.names_size += name.size() + 1;
+	h.program_offset = h.names_offset + h.names_size;
+	h.program_offset += (alignof(image_instruction) - h.program_offset % alignof(image_instruction))
+		% alignof(image_instruction);
+	h.program_count = tm.program.size();
+	h.table_offset = h.program_offset + h.program_count * sizeof(image_instruction);
+	h.table_offset += (TABLE_ALIGNMENT - h.table_offset % TABLE_ALIGNMENT) % TABLE_ALIGNMENT;
+
+	// written aside and renamed: processes mapping the old file keep their pages
+	std::string temp = filename + ".tmp";
+	std::ofstream out(temp, std::ios::binary);
+	if (!out.is_open())
+		throw std::runtime_error("Cannot open file " + temp + " for writing");
+
+	write_value(out, h);
+	uint64_t offset = sizeof(image_header);
+	for (const std::string &name : tm.state_name) {
+		out.write(name.c_str(), name.size() + 1);
+		offset += name.size() + 1;
+	}
+	write_padding(out, offset, alignof(image_instruction));
+	for (const instruction &i : tm.program) {
+		image_instruction r = { i.from_state, i.to_state, i.symbol_read, i.symbol_write,
+			static_cast<uint8_t>(i.tape_direction), 0 };
+		write_value(out, r);
+		offset += sizeof(r);
+	}
+	write_padding(out, offset, TABLE_ALIGNMENT);
+	out.write(reinterpret_cast<const char *>(table.get_cells()),
+		table.get_size() * sizeof(transition_table::cell));
+
+	out.close();
+	if (!out)
+		throw std::runtime_error("Error writing file " + temp);
+	if (std::rename(temp.c_str(), filename.c_str()) != 0)
+		throw std::runtime_error("Cannot rename " + temp + " to " + filename);
+}
+
+// everything is checked: the file may be stale, corrupt or not written by
+// save_binary_program at all, and it is picked up next to the sources
+static void read_program(const program_image &image, const std::string &filename, std::vector<std::string> &names,
+	std::vector<instruction> &program)
+{
+	const image_header &h = image.header();
+
+	const char *p = image.at(h.names_offset);
+	const char *end = p + h.names_size;
+	names.reserve(h.states);
+	while (p < end && names.size() < h.states) {
+		const char *zero = static_cast<const char *>(std::memchr(p, '\0', end - p));
+		if (zero == nullptr)
+			break;
+		names.emplace_back(p, zero);
+		p = zero + 1;
+	}
+	if (names.size() != h.states)
+		throw std::runtime_error("Invalid compiled program " + filename);
+
+	const image_instruction *records = reinterpret_cast<const image_instruction *>(image.at(h.program_offset));
+	program.resize(h.program_count);
+	for (size_t k = 0; k < program.size(); k++) {
+		const image_instruction &r = records[k];
+		if (r.from_state < 0 || r.to_state < 0 || static_cast<uint32_t>(r.from_state) >= h.states
+			|| static_cast<uint32_t>(r.to_state) >= h.states || r.tape_direction > 1
+			|| !is_symbol(r.symbol_read) || !is_symbol(r.symbol_write))
+			throw std::runtime_error("Invalid compiled program " + filename);
+		program[k] = { r.from_state, r.symbol_read, r.to_state, r.symbol_write,
+			static_cast<direction>(r.tape_direction) };
+	}
+}
+
+// the hot loop indexes the rows with the next state of every cell it reads,
+// one pass over the mapped table keeps it inside
+static void check_table(const program_image &image, const std::string &filename)
+{
+	const image_header &h = image.header();
+	const transition_table::cell *cells = reinterpret_cast<const transition_table::cell *>(image.at(h.table_offset));
+	size_t size = size_t(h.states) << h.row_shift;
+	for (size_t k = 0; k < size; k++) {
+		transition_table::cell c = cells[k];
+		if (transition_table::next_state(c) >= h.states || transition_table::head_delta(c) > 1)
+			throw std::runtime_error("Invalid compiled program " + filename);
+	}
+}
+
+void load_program_image(const std::shared_ptr<program_image> &image, const std::string &filename, turing_machine &tm)
+{
+	std::vector<std::string> names;
+	std::vector<instruction> program;
+	read_program(*image, filename, names, program);
+	check_table(*image, filename);
+
+	const image_header &h = image->header();
+	tm.set_tape_count(1);
+	tm.program = std::move(program);
+	tm.program_lines.clear();
+	tm.state_name = std::move(names);
+	tm.state_code.clear();
+	for (size_t i = 0; i < tm.state_name.size(); i++)
+		tm.state_code[tm.state_name[i]] = i;
+	tm.table = transition_table(image, reinterpret_cast<const transition_table::cell *>(image->at(h.table_offset)),
+		h.states, h.row_shift, h.columns);
+	tm.table_dirty = false;
+	tm.native.reset();
+	tm.threaded.reset();
+	// the table is swapped without a rebuild, the counters start over here
+	if (tm.prof)
+		tm.prof->clear();
+	if (static_cast<size_t>(tm.current_state) >= tm.state_name.size())
+		tm.current_state = turing_machine::INIT_STATE;
+
+	if (h.settings & ALL_SETTINGS) {
+		if (h.settings & SETTING_TAPE_MODE)
+			tm.mode = static_cast<tape_mode>(h.mode);
+		if (h.settings & SETTING_INITIAL_SYMBOL)
+			tm.initial_symbol = h.initial_symbol;
+		long length = h.settings & SETTING_MEMORY_SIZE ? h.memory_size : tm.get_tape_length();
+		tm.tape.reset(tape_storage::create(tm.mode, length, tm.initial_symbol));
+		if (h.settings & SETTING_MEMORY_SIZE)
+			tm.head_pos = length / 2;
+		tm.reset();
+	}
+	tm.forget_history();
+}
+
+void load_binary_program(const std::string &filename, turing_machine &tm)
+{
+	load_program_image(std::make_shared<program_image>(filename), filename, tm);
+}
+
+bool load_program_cache(const std::string &source, turing_machine &tm)
+{
+	std::string cache = binary_program_cache(source);
+	if (tm.tape_count != 1 || !tm.program.empty() || tm.state_name.size() != 2 || !is_binary_program(cache))
+		return false;
+
+	// a cache written by another version or machine, or a damaged one, is
+	// just ignored: nothing is changed before the image is checked
+	try {
+		std::shared_ptr<program_image> image = std::make_shared<program_image>(cache);
+		if (image->header().source_hash != hash_source(source))
+			return false;
+		load_program_image(image, cache, tm);
+	} catch (const std::exception &e) {
+		return false;
+	}
+	return true;
+}
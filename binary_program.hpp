@@ -0,0 +1,49 @@
+#ifndef BINARY_PROGRAM_H
+#define BINARY_PROGRAM_H
+
+#include <cstdint>
+#include <string>
+
+#include "turing_machine.hpp"
+
+/*
+ * Compiled program files (.tmb): settings, interned state names, program and
+ * the ready to run transition table. The file is mapped read only and the
+ * table is used in place, so loading costs a copy of the program only and
+ * every process running the same file shares its pages. The layout is the
+ * one of the machine that wrote it: a cache, not an exchange format.
+ *
+ * A .tmb next to a .tm source holds the hash of the source it was compiled
+ * from, and is only used by load_file while it still matches.
+ */
+
+// settings stored in a compiled program, the others are left untouched
+enum program_settings : unsigned {
+	SETTING_MEMORY_SIZE = 1,
+	SETTING_TAPE_MODE = 2,
+	SETTING_INITIAL_SYMBOL = 4,
+	ALL_SETTINGS = 7
+};
+
+// true if the file starts like a compiled program
+bool is_binary_program(const std::string& filename);
+
+// name of the compiled cache of a source: foo.tm -> foo.tmb
+std::string binary_program_cache(const std::string& source);
+
+// hash of the contents of a source file, never 0
+uint64_t hash_source(const std::string& filename);
+
+// writes the program and the given settings of the machine, with the hash
+// of the source it was compiled from (0 for none)
+void save_binary_program(const std::string& filename, const turing_machine& tm, uint64_t source_hash = 0,
+	unsigned settings = ALL_SETTINGS);
+
+// loads a compiled program in place of the program of the machine
+void load_binary_program(const std::string& filename, turing_machine& tm);
+
+// loads the compiled cache of `source` if it is up to date and the machine
+// has no program yet, false when the source has to be parsed
+bool load_program_cache(const std::string& source, turing_machine& tm);
+
+#endif
@@ -0,0 +1,231 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'T', 'M', 'C', 'K'};
+static const uint32_t VERSION = 1;
+
+// bytes taken in the file by an instruction and by the size of a string
+static const uint64_t INSTRUCTION_SIZE = 2 * sizeof(int32_t) + 2 * sizeof(char) + sizeof(uint8_t);
+static const uint64_t STRING_SIZE = sizeof(uint32_t);
+// the sparse and packed tapes don't write their blank cells, so their length
+// isn't bounded by the file; this keeps it and the positions far from overflowing
+static const long MAX_TAPE_LENGTH = 1L << 48;
+
+template <typename T>
+static void write_value(std::ostream &out, T value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void write_string(std::ostream &out, const std::string &s)
+{
+	write_value<uint32_t>(out, s.size());
+	out.write(s.data(), s.size());
+}
+
+template <typename T>
+static T read_value(std::istream &in)
+{
+	T value;
+	if (!in.read(reinterpret_cast<char *>(&value), sizeof(value)))
+		throw std::runtime_error("Truncated checkpoint file");
+	return value;
+}
+
+// the symbols index the transition table, as when added by hand; '-' is one of them
+static bool is_symbol(char c)
+{
+	return static_cast<unsigned char>(c) < transition_table::SYMBOLS;
+}
+
+// bytes left to read, to check the counts read before allocating for them
+static uint64_t remaining(std::istream &in, uint64_t size)
+{
+	std::streamoff pos = in.tellg();
+	return pos < 0 || static_cast<uint64_t>(pos) > size ? 0 : size - pos;
+}
+
+static std::string read_string(std::istream &in, uint64_t size)
+{
+	uint32_t length = read_value<uint32_t>(in);
+	if (length > remaining(in, size))
+		throw std::runtime_error("Truncated checkpoint file");
+	std::string s(length, '\0');
+	if (!in.read(&s[0], s.size()))
+		throw std::runtime_error("Truncated checkpoint file");
+	return s;
+}
+
+void save_checkpoint(const std::string &filename, const turing_machine &tm)
+{
+	tm.check_single_tape("checkpoints");
+
+	// written aside and renamed, so a crash never leaves a broken checkpoint
+	std::string temp = filename + ".tmp";
+	std::ofstream out(temp, std::ios::binary);
+	if (!out.is_open())
+		throw std::runtime_error("Cannot open file " + temp + " for writing");
+
+	out.write(MAGIC, sizeof(MAGIC));
+	write_value<uint32_t>(out, VERSION);
+	write_value<uint8_t>(out, static_cast<uint8_t>(tm.mode));
+	write_value<uint8_t>(out, static_cast<uint8_t>(tm.engine));
+	write_value<char>(out, tm.initial_symbol);
+	write_value<uint8_t>(out, tm.is_halt);
+	write_value<int64_t>(out, tm.head_pos);
+	write_value<int64_t>(out, tm.computation_steps);
+	write_value<int32_t>(out, tm.current_state);
+
+	write_value<uint32_t>(out, tm.state_name.size());
+	for (const std::string &name : tm.state_name)
+		write_string(out, name);
+
+	write_value<uint32_t>(out, tm.program.size());
+	for (const instruction &i : tm.program) {
+		write_value<int32_t>(out, i.from_state);
+		write_value<char>(out, i.symbol_read);
+		write_value<int32_t>(out, i.to_state);
+		write_value<char>(out, i.symbol_write);
+		write_value<uint8_t>(out, static_cast<uint8_t>(i.tape_direction));
+	}
+
+	// tape: its extent, then (position, length, cells) chunks of stored cells
+	// ended by an empty chunk
+	const tape_storage &tape = *tm.tape;
+	write_value<int64_t>(out, tape.get_begin());
+	write_value<int64_t>(out, tape.get_length());
+	for (long pos = tape.get_begin(); pos < tape.get_end(); ) {
+		const char *cells;
+		long count = tape.view(pos, cells);
+		if (cells != nullptr) {
+			write_value<int64_t>(out, pos);
+			write_value<int64_t>(out, count);
+			out.write(cells, count);
+		}
+		pos += count;
+	}
+	write_value<int64_t>(out, 0);
+	write_value<int64_t>(out, 0);
+
+	out.close();
+	if (!out)
+		throw std::runtime_error("Error writing file " + temp);
+	if (std::rename(temp.c_str(), filename.c_str()) != 0)
+		throw std::runtime_error("Cannot rename " + temp + " to " + filename);
+}
+
+void restore_checkpoint(const std::string &filename, turing_machine &tm)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + filename + " for reading");
+	in.seekg(0, std::ios::end);
+	uint64_t size = in.tellg();
+	in.seekg(0);
+
+	char magic[sizeof(MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+		|| read_value<uint32_t>(in) != VERSION)
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+
+	uint8_t mode_code = read_value<uint8_t>(in);
+	uint8_t engine_code = read_value<uint8_t>(in);
+	if (mode_code > static_cast<uint8_t>(tape_mode::packed) || engine_code > static_cast<uint8_t>(engine_type::native))
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+	tape_mode mode = static_cast<tape_mode>(mode_code);
+	engine_type engine = static_cast<engine_type>(engine_code);
+	char initial_symbol = read_value<char>(in);
+	if (!is_symbol(initial_symbol))
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+	bool is_halt = read_value<uint8_t>(in);
+	long head_pos = read_value<int64_t>(in);
+	long computation_steps = read_value<int64_t>(in);
+	int current_state = read_value<int32_t>(in);
+
+	uint32_t states = read_value<uint32_t>(in);
+	if (states < 2 || states > transition_table::MAX_STATES || states > remaining(in, size) / STRING_SIZE)
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+	std::vector<std::string> state_name(states);
+	for (std::string &name : state_name)
+		name = read_string(in, size);
+
+	uint32_t instructions = read_value<uint32_t>(in);
+	if (instructions > remaining(in, size) / INSTRUCTION_SIZE)
+		throw std::runtime_error("Truncated checkpoint file");
+	std::vector<instruction> program(instructions);
+	for (instruction &i : program) {
+		i.from_state = read_value<int32_t>(in);
+		i.symbol_read = read_value<char>(in);
+		i.to_state = read_value<int32_t>(in);
+		i.symbol_write = read_value<char>(in);
+		uint8_t dir = read_value<uint8_t>(in);
+		i.tape_direction = static_cast<direction>(dir);
+		if (i.from_state < 0 || i.to_state < 0 || static_cast<size_t>(i.from_state) >= state_name.size()
+			|| static_cast<size_t>(i.to_state) >= state_name.size() || dir > 1
+			|| !is_symbol(i.symbol_read) || !is_symbol(i.symbol_write))
+			throw std::runtime_error("Invalid checkpoint file " + filename);
+	}
+	if (current_state < 0 || static_cast<size_t>(current_state) >= state_name.size())
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+
+	long begin = read_value<int64_t>(in);
+	long length = read_value<int64_t>(in);
+	// the fixed and unbounded tapes write every cell
+	bool stored = mode == tape_mode::fixed || mode == tape_mode::unbounded;
+	if (length < 0 || length > MAX_TAPE_LENGTH || begin < -MAX_TAPE_LENGTH || begin > MAX_TAPE_LENGTH
+		|| (mode != tape_mode::unbounded && begin != 0)
+		|| (stored && static_cast<uint64_t>(length) > remaining(in, size)))
+		throw std::runtime_error("Invalid checkpoint file " + filename);
+	std::unique_ptr<tape_storage> tape(tape_storage::create(mode, length, initial_symbol));
+	tape_segment seg;
+	if (mode == tape_mode::unbounded && length > 0) {
+		tape->acquire(begin, seg);
+		tape->acquire(begin + length - 1, seg);
+	}
+
+	// chunks are read straight into the tape storage
+	while (true) {
+		long pos = read_value<int64_t>(in);
+		long count = read_value<int64_t>(in);
+		if (count == 0)
+			break;
+
+		while (count > 0) {
+			if (!tape->acquire(pos, seg))
+				throw std::runtime_error("Invalid checkpoint file " + filename);
+			long n = std::min(count, seg.end - pos);
+			char *cells = seg.cells + (pos - seg.begin);
+			if (!in.read(cells, n))
+				throw std::runtime_error("Truncated checkpoint file");
+			if (!std::all_of(cells, cells + n, is_symbol))
+				throw std::runtime_error("Invalid checkpoint file " + filename);
+			pos += n;
+			count -= n;
+		}
+	}
+
+	tm.set_tape_count(1);
+	tm.mode = mode;
+	tm.engine = engine;
+	tm.initial_symbol = initial_symbol;
+	tm.is_halt = is_halt;
+	tm.head_pos = head_pos;
+	tm.computation_steps = computation_steps;
+	tm.current_state = current_state;
+	tm.tape = std::move(tape);
+	tm.program = std::move(program);
+	tm.program_lines.clear();
+	tm.state_name = std::move(state_name);
+	tm.state_code.clear();
+	for (size_t i = 0; i < tm.state_name.size(); i++)
+		tm.state_code[tm.state_name[i]] = i;
+	tm.table_dirty = true;
+	if (tm.prof)
+		tm.prof->clear();
+	tm.forget_history();
+}
@@ -0,0 +1,17 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+
+#include "turing_machine.hpp"
+
+/*
+ * Binary snapshot of a whole machine: settings, state names, program, head,
+ * state, step count and tape. The tape is stored as raw chunks of stored
+ * cells (a single one for fixed and unbounded tapes, one per allocated page
+ * for sparse tapes) that are read straight into the new tape.
+ */
+void save_checkpoint(const std::string& filename, const turing_machine& tm);
+void restore_checkpoint(const std::string& filename, turing_machine& tm);
+
+#endif
@@ -13,6 +13,10 @@
 #include "command_line.hpp"
 #include "turing_machine.hpp"
 #include "tokenizer.hpp"
+#include "beaver_search.hpp"
+#include "checkpoint.hpp"
+#include "binary_program.hpp"
+#include "program_loader.hpp"
 
 #ifdef UNIX 
 #include <unistd.h>
@@ -23,19 +27,40 @@
 #include "ncurses_gui.hpp"
 #endif
 
-bool stop = false;
+std::atomic<bool> stop(false);
+
+// bytes of program file read at once by load_file
+const static size_t LOAD_CHUNK_SIZE = 1 << 20;
+
+// cells printed on each side of the head in the batch results
+const static int BATCH_WINDOW = 20;
+
+// transitions and states listed by the profile report by default
+const static unsigned long PROFILE_TOP = 20;
 
 const static char * USAGE = 
 	"    - load (<) [path] : load program from file\n"
-	"    - save (>) [path] : save the current program to file\n"
-	"    - run (r) : execute the machine till it goes to a halt state\n"
+	"    - save (>) [--binary] [path] : save the current program to file, compiled to the binary format with `--binary`\n"
+	"    - compile_program [source] [output] : compile a program made of settings and instructions to a binary file (default: `source` with the .tmb extension), used by load in place of the source while it doesn't change\n"
+	"    - run (r) [--macro k | [--cycle] [--translated]] [--checkpoint file nsteps] : execute the machine till it goes to a halt state, optionally simulating blocks of `k` cells at once, stopping when the configuration repeats and/or when it repeats shifted on an unbounded tape, saving a checkpoint to `file` every `nsteps` steps and when interrupted\n"
+	"    - checkpoint [path] : save the whole machine, program, tape and state, to a binary file\n"
+	"    - restore [path] : restore a machine saved with `checkpoint`\n"
+	"    - engine [engine] : execute with the `table` interpreter, `threaded` code, the `rle` engine that crosses runs of equal symbols at once or `native` compiled code\n"
+	"    - batch [--cycle] [--translated] [input] [output] [nsteps] [nthreads] : run the program on every line of `input` as initial tape, at most `nsteps` steps each (0 for no limit) on `nthreads` threads (default all cores), optionally stopping the inputs whose configuration repeats, also shifted, writing status, state, steps and the tape around the head to `output` in input order\n"
+	"    - beaver [nstates] [nsymbols] [nsteps] [nthreads] [holdouts] : enumerate the `nstates` states `nsymbols` symbols machines in tree normal form, running each one at most `nsteps` steps on `nthreads` threads, and print the busy beaver champion. Machines still running are written to the `holdouts` file\n"
+	"    - compile : compile the program to native code and execute it with the `native` engine\n"
 	"    - step (s) [nsteps] : execute `nsteps` computations steps. Default 1.\n"
+	"    - back (b) [nsteps] : go back `nsteps` computation steps. Default 1. Needs the undo log\n"
+	"    - undo_log [nsteps] : remember the last `nsteps` steps to go back, 0 to disable\n"
+	"    - profile [on | off | clear | report [n] | csv path] : count the steps taken through every transition while stepping and running (without --macro, --cycle or --translated), print the `n` hottest instructions and the steps per state and symbol read (default 20), or write every transition taken to `path` as CSV\n"
 	"    - memorysize [nbytes] : set the size of the tape to `nbytes`\n"
+	"    - tapes [k] : turn the machine into a `k` tapes machine (1 to 4, default 1) and clear the program. Every instruction reads, writes and moves `k` symbols\n"
+	"    - tape_mode [mode] : `fixed` tape of `memorysize` cells, `sparse` tape of `memorysize` cells allocated on first use, `packed` tape of `memorysize` cells of 1, 2, 4 or 8 bits depending on the number of symbols or `unbounded` tape growing on demand\n"
 	"    - initialsymbol [symbol] : set the initla symbol for the tape\n"
-	"    - set_tape [start] [string] : put `string` on the tape starting from `start`\n"
+	"    - set_tape [start] [string] [tape] : put `string` on the tape number `tape` (default 1) starting from `start`\n"
 	"    - set_state [state] : set the state to `state`\n"
-	"    - move_head [pos] : move the head to pos\n"
-	"    - add (+) [from] [read] [to] [write] [dir] : add a new instruction. From `from` if you read `read` go to `to`, write `write` and move the head to `dir`. `dir` is `<` for left and `>` for right.\n"
+	"    - move_head [pos] [tape] : move the head of the tape number `tape` (default 1) to pos\n"
+	"    - add (+) [from] [read] [to] [write] [dir] : add a new instruction. From `from` if you read `read` go to `to`, write `write` and move the head to `dir`. `dir` is `<` for left and `>` for right. On a machine with `k` tapes `read`, `write` and `dir` have a character per tape: `-` in `read` matches any symbol, in `write` keeps the symbol and in `dir` keeps the head\n"
 	"    - del (-) [n] : deletes the instruction number `n``\n"
 	"    - print_program (pp) : print the program\n"
 	"    - print_state (ps) : print the machine state\n" 
@@ -60,6 +85,170 @@ static void sigint_handler(int /* unused */)
 	stop = true;
 }
 
+static void check_status(run_status status)
+{
+	if (status == run_status::illegal_instruction || status == run_status::out_of_memory)
+		throw std::runtime_error(to_string(status));
+}
+
+static tape_mode parse_tape_mode(const std::string& name)
+{
+	if (name == "fixed")
+		return tape_mode::fixed;
+	if (name == "unbounded")
+		return tape_mode::unbounded;
+	if (name == "sparse")
+		return tape_mode::sparse;
+	if (name == "packed")
+		return tape_mode::packed;
+	throw std::runtime_error("Invalid tape mode: " + name);
+}
+
+static engine_type parse_engine(const std::string& name)
+{
+	if (name == "table")
+		return engine_type::table;
+	if (name == "threaded")
+		return engine_type::threaded;
+	if (name == "rle")
+		return engine_type::rle;
+	if (name == "native")
+		return engine_type::native;
+	throw std::runtime_error("Invalid engine: " + name);
+}
+
+// optional tape number of a command, 1 based, the first tape if missing
+static int next_tape_number(tokenizer &t)
+{
+	try {
+		return static_cast<int>(t.next_ulong()) - 1;
+	} catch (const std::exception &e) {
+		return 0;
+	}
+}
+
+static const char *status_token(run_status status)
+{
+	switch (status) {
+		case run_status::halted: return "halt";
+		case run_status::illegal_instruction: return "illegal";
+		case run_status::out_of_memory: return "oom";
+		case run_status::step_limit: return "limit";
+		case run_status::interrupted: return "interrupted";
+		case run_status::cycling: return "cycle";
+		case run_status::translated: return "translated";
+	}
+	return "unknown";
+}
+
+static void run_batch_file(const std::string& input, const std::string& output, long max_steps, bool check_cycles,
+	bool check_translations, unsigned threads, turing_machine &m, std::ostream& out)
+{
+	std::ifstream in(input);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + input + " for reading");
+	std::vector<std::string> tapes;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		tapes.push_back(line);
+	}
+
+	std::ofstream result(output);
+	if (!result.is_open())
+		throw std::runtime_error("Cannot open file " + output + " for writing");
+
+	stop = false;
+	std::vector<batch_result> results = m.run_inputs(tapes, max_steps, BATCH_WINDOW, check_cycles, check_translations,
+		threads, &stop);
+	for (const batch_result &r : results) {
+		result << status_token(r.status) << ' ' << m.get_state_name(r.state) << ' ' << r.steps << ' '
+			<< r.window << '\n';
+	}
+	out << results.size() << " inputs processed" << std::endl;
+}
+
+static void run_beaver_search(int states, int symbols, long max_steps, unsigned threads, const std::string& holdouts,
+	std::ostream& out)
+{
+	beaver_search search(states, symbols, max_steps);
+	stop = false;
+	beaver_report report = search.run(threads, &stop);
+
+	if (report.interrupted)
+		out << "Interrupted, partial results:" << std::endl;
+	out << report.machines << " machines simulated, " << report.halting << " halting, "
+		<< report.cycling << " cycling, " << report.holdouts << " holdouts" << std::endl;
+	if (report.halting > 0)
+		out << "Champion: " << report.champion << " (" << report.best_steps << " steps)" << std::endl;
+
+	if (holdouts.empty())
+		return;
+	std::ofstream file(holdouts);
+	if (!file.is_open())
+		throw std::runtime_error("Cannot open file " + holdouts + " for writing");
+	for (const std::string &machine : report.holdout_machines)
+		file << machine << '\n';
+}
+
+// run with the options of the run command, saving a checkpoint every
+// `period` steps and when interrupted if a checkpoint file is given
+static run_status run_command(tokenizer &t, turing_machine &m, std::ostream& out)
+{
+	std::string option, checkpoint;
+	unsigned long macro = 0, period = 0;
+	bool check_cycles = false, check_translations = false;
+
+	while (true) {
+		try {
+			option = t.next_string();
+		} catch (const std::exception &e) {
+			break;
+		}
+		if (option == "--macro") {
+			macro = t.next_ulong();
+			if (macro == 0)
+				throw std::runtime_error("Invalid block size");
+		} else if (option == "--cycle") {
+			check_cycles = true;
+		} else if (option == "--translated") {
+			check_translations = true;
+		} else if (option == "--checkpoint") {
+			checkpoint = t.next_string();
+			period = t.next_ulong();
+		} else {
+			throw std::runtime_error("Invalid run option: " + option);
+		}
+	}
+
+	if (macro > 0 && (check_cycles || check_translations))
+		throw std::runtime_error("--macro cannot be combined with --cycle or --translated");
+
+	// detectors restart after every checkpoint
+	long max_steps = checkpoint.empty() || period == 0 ? -1 : period;
+	m.check_runnable();
+	stop = false;
+	while (true) {
+		run_status status;
+		if (macro > 0)
+			status = m.run_macro(macro, max_steps, &stop);
+		else if (check_cycles)
+			status = m.run_cycle_check(max_steps, &stop, check_translations);
+		else if (check_translations)
+			status = m.run_translation_check(max_steps, &stop);
+		else
+			status = m.run(max_steps, &stop);
+
+		if (!checkpoint.empty() && (status == run_status::step_limit || status == run_status::interrupted)) {
+			save_checkpoint(checkpoint, m);
+			out << "Checkpoint saved at step " << m.get_computation_steps() << std::endl;
+		}
+		if (status != run_status::step_limit)
+			return status;
+	}
+}
+
 void save_file(const std::string& filename, const turing_machine& tm) 
 {
 	std::ofstream out(filename);
@@ -67,9 +256,13 @@ void save_file(const std::string& filename, const turing_machine& tm)
 		throw std::runtime_error("Cannot open file " + filename + " for writing");
 	out << "; machine program output\n";
 	out << "memsize " << tm.get_tape_length() << '\n';
+	if (tm.get_tape_mode() != tape_mode::fixed)
+		out << "tape_mode " << to_string(tm.get_tape_mode()) << '\n';
 	out << "initsymbol " << tm.initial_symbol << '\n';
+	if (tm.tape_count > 1)
+		out << "tapes " << tm.tape_count << '\n';
 	out << "; transition function\n";
-	for (const turing_machine::instruction &i : tm.program) {
+	for (const instruction &i : tm.program) {
 		out << "+ ";
 		out << tm.get_state_name(i.from_state) << ' ';
 		out << i.symbol_read << ' ', 
@@ -77,24 +270,116 @@ void save_file(const std::string& filename, const turing_machine& tm)
 		out << i.symbol_write << ' ',
 		out << (i.tape_direction == direction::L ? '<' : '>') << '\n';
 	}
+	for (const tuple_instruction &i : tm.tuple_program) {
+		out << "+ " << tm.get_state_name(i.from_state) << ' ' << i.symbols_read << ' ';
+		out << tm.get_state_name(i.to_state) << ' ' << i.symbols_write << ' ' << i.moves << '\n';
+	}
 	out << "; end of file\n";
 }
 
+// compiles a source made of settings and instructions only, so that loading
+// the compiled program is the same as loading the source
+static void compile_program_file(const std::string& source, const std::string& output, std::ostream& out)
+{
+	uint64_t source_hash = hash_source(source);
+	std::ifstream in(source);
+	if (!in.is_open())
+		throw std::runtime_error("Error opening file " + source + " for reading");
+
+	turing_machine compiled;
+	unsigned settings = 0;
+	std::string line, command;
+	for (int i = 1; std::getline(in, line); i++) {
+		try {
+			command = tokenizer(line).next_string();
+		} catch (const std::exception &e) {
+			continue;
+		}
+		switch (hash(command.c_str())) {
+		case hash("memsize"):
+		case hash("memorysize"):
+			settings |= SETTING_MEMORY_SIZE;
+			break;
+		case hash("tape_mode"):
+			settings |= SETTING_TAPE_MODE;
+			break;
+		case hash("initsymbol"):
+		case hash("initialsymbol"):
+			settings |= SETTING_INITIAL_SYMBOL;
+			break;
+		case hash("add"):
+		case hash("+"):
+			break;
+		default:
+			throw std::runtime_error("Cannot compile " + source + " line " + std::to_string(i) + ": " + command
+				+ " is not a setting or an instruction");
+		}
+		try {
+			parse_line(line, compiled, out);
+		} catch (const std::exception &e) {
+			throw std::runtime_error("Error at file " + source + " line " + std::to_string(i) + " : " + e.what());
+		}
+	}
+
+	std::string filename = output.empty() ? binary_program_cache(source) : output;
+	save_binary_program(filename, compiled, source_hash, settings);
+	out << "Program compiled to " << filename << std::endl;
+}
+
 void load_file(const std::string& filename, turing_machine &m, std::ostream& out) 
 {
-	std::ifstream in(filename);
+	if (is_binary_program(filename)) {
+		load_binary_program(filename, m);
+		return;
+	}
+	if (load_program_cache(filename, m))
+		return;
+
+	std::ifstream in(filename, std::ios::binary);
 	if (!in.is_open()) 
 		throw std::runtime_error("Error opening file " + filename + " for reading");
-	std::string line;
+
+	// read in large chunks, instruction lines are parsed in place by the
+	// loader and only the other lines go through parse_line
+	program_loader loader(m);
+	std::vector<char> buffer(LOAD_CHUNK_SIZE);
+	size_t filled = 0;
 	int i = 1;
-	while (std::getline(in, line)) {
-		try {
-			parse_line(line, m, out);
-			i++;
-		} catch (const std::exception &e) {
-			out << "Error at file " << filename << " line " << i << " : " <<  e.what() << std::endl;
+	bool eof = false;
+	while (!eof) {
+		in.read(buffer.data() + filled, buffer.size() - filled);
+		eof = static_cast<size_t>(in.gcount()) < buffer.size() - filled;
+		filled += in.gcount();
+
+		const char *p = buffer.data();
+		const char *last = p + filled;
+		while (p < last) {
+			const char *newline = static_cast<const char *>(std::memchr(p, '\n', last - p));
+			if (newline == nullptr && !eof)
+				break;
+			const char *end = newline != nullptr ? newline : last;
+			try {
+				if (!loader.parse(p, end)) {
+					loader.flush();
+					parse_line(std::string(p, end), m, out);
+				}
+				i++;
+			} catch (const std::exception &e) {
+				out << "Error at file " << filename << " line " << i << " : " <<  e.what() << std::endl;
+			}
+			p = end + 1;
+		}
+
+		// keep the partial last line, growing the buffer for very long lines
+		filled = 0;
+		if (p < last) {
+			filled = last - p;
+			std::memmove(buffer.data(), p, filled);
 		}
+		if (filled == buffer.size())
+			buffer.resize(buffer.size() * 2);
 	}
+	loader.flush();
 }
 
 void parse_line(const std::string& line, turing_machine &m, std::ostream& out) 
@@ -103,6 +388,7 @@ void parse_line(const std::string& line, turing_machine &m, std::ostream& out)
 	char r, w;
 	std::string from, to, command;
 	tokenizer t;
+	run_status status;
 
 	try {
 		t = tokenizer(line);
@@ -127,7 +413,20 @@ void parse_line(const std::string& line, turing_machine &m, std::ostream& out)
 		break;
 	case hash("save"):
 	case hash(">"):
-		save_file(t.next_string(), m);
+		from = t.next_string();
+		if (from == "--binary")
+			save_binary_program(t.next_string(), m);
+		else
+			save_file(from, m);
+		break;
+	case hash("compile_program"):
+		from = t.next_string();
+		try {
+			to = t.next_string();
+		} catch (const std::exception &e) {
+			to = "";
+		}
+		compile_program_file(from, to, out);
 		break;
 	case hash("step"):
 	case hash("s"):
@@ -136,23 +435,123 @@ void parse_line(const std::string& line, turing_machine &m, std::ostream& out)
 		} catch(const std::exception &e) {
 			steps = 1;
 		}
-		while (steps-- && m.step());
+		m.check_runnable();
+		stop = false;
+		check_status(m.step_n(steps, &stop));
 		break;
 	case hash("memsize"):
 	case hash("memorysize"):
 		m.set_memory_size(t.next_ulong());
 		break;
+	case hash("tape_mode"):
+		m.set_tape_mode(parse_tape_mode(t.next_string()));
+		break;
+	case hash("tapes"):
+		m.set_tape_count(t.next_ulong());
+		break;
+	case hash("engine"):
+		m.set_engine(parse_engine(t.next_string()));
+		break;
+	case hash("batch"): {
+		bool check_cycles = false, check_translations = false;
+		for (from = t.next_string(); from.compare(0, 2, "--") == 0; from = t.next_string()) {
+			if (from == "--cycle")
+				check_cycles = true;
+			else if (from == "--translated")
+				check_translations = true;
+			else
+				throw std::runtime_error("Invalid batch option: " + from);
+		}
+		to = t.next_string();
+		long max_steps = -1;
+		unsigned threads = 0;
+		try {
+			steps = t.next_ulong();
+			max_steps = steps > 0 ? steps : -1;
+			threads = t.next_ulong();
+		} catch (const std::exception &e) {
+		}
+		run_batch_file(from, to, max_steps, check_cycles, check_translations, threads, m, out);
+		break;
+	}
+	case hash("beaver"): {
+		int states = t.next_ulong();
+		int symbols = t.next_ulong();
+		steps = t.next_ulong();
+		unsigned threads = 0;
+		try {
+			threads = t.next_ulong();
+			to = t.next_string();
+		} catch (const std::exception &e) {
+			to = "";
+		}
+		run_beaver_search(states, symbols, steps, threads, to, out);
+		break;
+	}
+	case hash("undo_log"):
+		m.set_undo_log(t.next_ulong());
+		break;
+	case hash("profile"): {
+		std::string action = "report";
+		try {
+			action = t.next_string();
+		} catch (const std::exception &e) {
+		}
+		if (action == "on" || action == "off") {
+			m.set_profiling(action == "on");
+		} else if (action == "clear") {
+			m.clear_profile();
+		} else if (action == "report") {
+			unsigned long top = PROFILE_TOP;
+			try {
+				top = t.next_ulong();
+			} catch (const std::exception &e) {
+			}
+			out << m.get_profile(top);
+		} else if (action == "csv") {
+			std::string filename = t.next_string();
+			std::ofstream file(filename);
+			if (!file.is_open())
+				throw std::runtime_error("Cannot open file " + filename + " for writing");
+			file << m.get_profile_csv();
+		} else {
+			throw std::runtime_error("Invalid profile option: " + action);
+		}
+		break;
+	}
+	case hash("back"):
+	case hash("b"):
+		try {
+			steps = t.next_ulong();
+		} catch(const std::exception &e) {
+			steps = 1;
+		}
+		m.back(steps);
+		break;
+	case hash("checkpoint"):
+		save_checkpoint(t.next_string(), m);
+		break;
+	case hash("restore"):
+		restore_checkpoint(t.next_string(), m);
+		break;
+	case hash("compile"): {
+		const native_program &native = m.compile_native();
+		out << "Program compiled to " << native.get_path() << (native.is_cached() ? " (cached)" : "") << std::endl;
+		break;
+	}
 	case hash("initsymbol"):
 	case hash("initialsymbol"):
 		m.set_initial_symbol(t.next_symbol());
 		break;
 	case hash("head_position"):
 	case hash("move_head"):
-		m.set_head_position(t.next_ulong());
+		ul = t.next_ulong();
+		m.set_head_position(ul, next_tape_number(t));
 		break;
 	case hash("set_tape"): 
 		ul = t.next_ulong();
-		m.set_tape(ul, t.next_string());
+		from = t.next_string();
+		m.set_tape(ul, from, next_tape_number(t));
 		break;
 	case hash("set_state"):
 		m.set_state(t.next_string());
@@ -177,6 +576,14 @@ void parse_line(const std::string& line, turing_machine &m, std::ostream& out)
 	case hash("add"):
 	case hash("+"):
 		from = t.next_string();
+		if (m.get_tape_count() > 1) {
+			size_t k = m.get_tape_count();
+			std::string read = t.next_symbols(k);
+			to = t.next_string();
+			std::string write = t.next_symbols(k);
+			m.add_instruction(from, read, to, write, t.next_moves(k));
+			break;
+		}
 		r = t.next_symbol();
 		to = t.next_string();
 		w = t.next_symbol();
@@ -193,10 +600,18 @@ void parse_line(const std::string& line, turing_machine &m, std::ostream& out)
 		break;
 	case hash("run"):
 	case hash("r"):
-		stop = false;
-		while (m.step() && !stop);
-		if (!stop)
-			out << "Machine reached halt state" << std::endl;
+		status = run_command(t, m, out);
+		check_status(status);
+		if (status == run_status::halted)
+			out << to_string(status) << std::endl;
+		if (status == run_status::cycling) {
+			out << to_string(status) << ": cycle of " << m.get_cycle_length() << " steps entered at step "
+				<< m.get_cycle_entry() << std::endl;
+		}
+		if (status == run_status::translated) {
+			out << to_string(status) << ": shifts by " << m.get_cycle_shift() << " cells every "
+				<< m.get_cycle_length() << " steps from step " << m.get_cycle_entry() << std::endl;
+		}
 		break;
 #ifdef HAS_GUI
 	case hash("gui"):	
@@ -244,6 +659,9 @@ void parse_cmdline(int argc, char *argv[])
 
 #endif
 
+// the benchmark links the commands with its own main
+#ifndef NO_MAIN
+
 int main(int argc, char *argv[]) 
 {
 	signal(SIGINT, sigint_handler);
@@ -273,3 +691,5 @@ int main(int argc, char *argv[])
 	}
 	exit(EXIT_SUCCESS);
 }
+
+#endif
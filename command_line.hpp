@@ -1,6 +1,7 @@
 #ifndef COMMAND_LINE_H
 #define COMMAND_LINE_H
 
+#include <atomic>
 #include <cstdio>
 
 #include "turing_machine.hpp"
@@ -13,7 +14,7 @@
 #  	endif
 #endif 
 
-extern bool stop;
+extern std::atomic<bool> stop;
 
 void parse_line(const std::string& line, turing_machine &tm, std::ostream&);
 void load_file(const std::string& filename, turing_machine &m, std::ostream&);
@@ -0,0 +1,191 @@
+#include "cycle_detector.hpp"
+
+#include <algorithm>
+
+cycle_detector::cycle_detector(const transition_table &table, const tape_storage &tape, long head, uint32_t state)
+	: table(table), blank(tape.get_blank()), hash(head_key(head, state)), low(head), high(head)
+{
+	for (long pos = tape.get_begin(); pos < tape.get_end(); ) {
+		const char *cells;
+		long count = tape.view(pos, cells);
+		for (long i = 0; cells != nullptr && i < count; i++)
+			if (cells[i] != blank)
+				hash ^= cell_key(pos + i, cells[i]);
+		pos += count;
+	}
+	tape.data_extent(low, high);
+
+	initial = save(tape, head, state);
+	saved = initial;
+	saved_hash = hash;
+}
+
+// splitmix64 finalizer, gives the keys of the positions without storing them
+uint64_t cycle_detector::mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+uint64_t cycle_detector::cell_key(long pos, char c)
+{
+	return mix(static_cast<uint64_t>(pos) * transition_table::SYMBOLS + static_cast<unsigned char>(c));
+}
+
+uint64_t cycle_detector::head_key(long pos, uint32_t state)
+{
+	return mix((static_cast<uint64_t>(pos) << 22 ^ state) ^ 0x5bd1e9955bd1e995ULL);
+}
+
+cycle_detector::configuration cycle_detector::save(const tape_storage &tape, long head, uint32_t state) const
+{
+	return { state, head, low, tape.read(low, high + 1) };
+}
+
+bool cycle_detector::matches(const tape_storage &tape, long head, uint32_t state) const
+{
+	if (state != saved.state || head != saved.head)
+		return false;
+
+	long saved_end = saved.begin + saved.cells.size();
+	for (long pos = std::min(low, saved.begin); pos < std::max(high + 1, saved_end); pos++) {
+		char old = pos >= saved.begin && pos < saved_end ? saved.cells[pos - saved.begin] : blank;
+		if (tape.get(pos) != old)
+			return false;
+	}
+	return true;
+}
+
+template <typename Check>
+long cycle_detector::advance(const transition_table &table, tape_storage &tape, long &head, uint32_t &state,
+	uint64_t &hash, long &low, long &high, long n, run_status &status, Check check)
+{
+	char blank = tape.get_blank();
+	tape_segment seg = { nullptr, 0, 0 };
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		if (head < seg.begin || head >= seg.end) {
+			if (!tape.acquire(head, seg)) {
+				status = run_status::out_of_memory;
+				break;
+			}
+		}
+
+		char &c = seg.cells[head - seg.begin];
+		transition_table::cell next = table.get_cell(state, c);
+		done++;
+		if (!transition_table::is_defined(next)) {
+			status = run_status::illegal_instruction;
+			break;
+		}
+
+		char write = transition_table::write_symbol(next);
+		if (write != c) {
+			hash ^= (c != blank ? cell_key(head, c) : 0) ^ (write != blank ? cell_key(head, write) : 0);
+			c = write;
+		}
+		hash ^= head_key(head, state);
+		head += transition_table::head_delta(next);
+		if ((head < seg.begin || head >= seg.end) && !tape.in_bounds(head)) {
+			status = run_status::out_of_memory;
+			break;
+		}
+		state = transition_table::next_state(next);
+		hash ^= head_key(head, state);
+		low = std::min(low, head);
+		high = std::max(high, head);
+
+		if (transition_table::is_stop(next)) {
+			status = run_status::halted;
+			break;
+		}
+		run_status event = check();
+		if (event != run_status::step_limit) {
+			status = event;
+			break;
+		}
+	}
+
+	return done;
+}
+
+static run_status never()
+{
+	return run_status::step_limit;
+}
+
+long cycle_detector::run(tape_storage &tape, long &head, uint32_t &state, long n, run_status &status,
+	translation_detector *translation)
+{
+	long done = advance(table, tape, head, state, hash, low, high, n, status, [&] {
+		distance++;
+		if (hash == saved_hash && matches(tape, head, state))
+			return run_status::cycling;
+		if (translation != nullptr && translation->observe(tape, head, state))
+			return run_status::translated;
+
+		// Brent: move the checkpoint here once the distance reaches the power of two
+		if (distance == power) {
+			saved = save(tape, head, state);
+			saved_hash = hash;
+			power *= 2;
+			distance = 0;
+		}
+		return run_status::step_limit;
+	});
+
+	if (status == run_status::cycling) {
+		length = distance;
+		entry = find_entry();
+	}
+	return done;
+}
+
+long cycle_detector::find_entry() const
+{
+	unbounded_tape tortoise(1, blank), hare(1, blank);
+	for (size_t i = 0; i < initial.cells.size(); i++) {
+		tortoise.set(initial.begin + i, initial.cells[i]);
+		hare.set(initial.begin + i, initial.cells[i]);
+	}
+
+	long t_head = initial.head, h_head = initial.head;
+	uint32_t t_state = initial.state, h_state = initial.state;
+	uint64_t t_hash = 0, h_hash = 0;
+	long t_low = initial.begin, t_high = initial.begin + initial.cells.size() - 1;
+	long h_low = t_low, h_high = t_high;
+	run_status status;
+
+	advance(table, hare, h_head, h_state, h_hash, h_low, h_high, length, status, never);
+
+	// the hashes start from the same value, so they differ only by the changes
+	// made since the start: equal hashes on the same steps mean equal configurations
+	long mu = 0;
+	while (true) {
+		if (t_hash == h_hash && t_head == h_head && t_state == h_state) {
+			bool same = true;
+			for (long pos = std::min(t_low, h_low); same && pos <= std::max(t_high, h_high); pos++)
+				same = tortoise.get(pos) == hare.get(pos);
+			if (same)
+				return mu;
+		}
+
+		advance(table, tortoise, t_head, t_state, t_hash, t_low, t_high, 1, status, never);
+		advance(table, hare, h_head, h_state, h_hash, h_low, h_high, 1, status, never);
+		mu++;
+	}
+}
+
+long cycle_detector::get_entry() const
+{
+	return entry;
+}
+
+long cycle_detector::get_length() const
+{
+	return length;
+}
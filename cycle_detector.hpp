@@ -0,0 +1,75 @@
+#ifndef CYCLE_DETECTOR_H
+#define CYCLE_DETECTOR_H
+
+#include <cstdint>
+#include <string>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+#include "translation_detector.hpp"
+
+/*
+ * Detects exact configuration repeats. The configuration (state, head
+ * position and tape) is summarized by a Zobrist hash: the xor of a random key
+ * for the (head position, state) pair and one per (position, symbol) pair of
+ * the non blank cells, updated in constant time at every step.
+ *
+ * Repeats are searched with Brent's algorithm: the configuration is saved
+ * after 1, 2, 4, ... steps from the previous checkpoint and every step compares
+ * its hash with the saved one. A hash match is confirmed by comparing the
+ * configurations, then the cycle entry is found by running two copies of the
+ * initial configuration one cycle length apart.
+ */
+class cycle_detector {
+	struct configuration {
+		uint32_t state;
+		long head;
+		long begin;		// position of cells[0]
+		std::string cells;	// cells visited or non blank, the rest is blank
+	};
+
+	const transition_table& table;
+	char blank;
+
+	uint64_t hash;
+	long low, high;		// extent of the visited and non blank cells
+
+	configuration initial;
+	configuration saved;
+	uint64_t saved_hash;
+	long power = 1;
+	long distance = 0;	// steps since the checkpoint
+
+	long entry = -1;
+	long length = -1;
+
+	static uint64_t mix(uint64_t x);
+	static uint64_t cell_key(long pos, char c);
+	static uint64_t head_key(long pos, uint32_t state);
+
+	configuration save(const tape_storage& tape, long head, uint32_t state) const;
+	bool matches(const tape_storage& tape, long head, uint32_t state) const;
+	long find_entry() const;
+
+	// runs n steps keeping the hash and the visited extent up to date,
+	// check() is called after every step and stops the run returning a
+	// status other than run_status::step_limit
+	template <typename Check>
+	static long advance(const transition_table& table, tape_storage& tape, long& head, uint32_t& state,
+		uint64_t& hash, long& low, long& high, long n, run_status& status, Check check);
+
+public:
+	cycle_detector(const transition_table& table, const tape_storage& tape, long head, uint32_t state);
+
+	// same contract as run_segments, stops with run_status::cycling when the
+	// configuration repeats. Steps are also passed to translation when given
+	long run(tape_storage& tape, long& head, uint32_t& state, long n, run_status& status,
+		translation_detector *translation = nullptr);
+
+	// steps from the start of the detection to the first configuration of the
+	// cycle, and length of the cycle. Valid once a cycle is found
+	long get_entry() const;
+	long get_length() const;
+};
+
+#endif
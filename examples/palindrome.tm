@@ -0,0 +1,29 @@
+; riconosce le stringhe palindrome di 0 e 1 con una macchina a due nastri:
+; copia l'input sul secondo nastro, torna all'inizio del primo e confronta
+; i due nastri leggendo il secondo al contrario.
+; scrive Y dopo l'input se e' palindroma, N al primo simbolo diverso
+
+echo Programma palindrome (2 nastri)
+
+memsize 100
+initsymbol _
+tapes 2 ; ogni istruzione legge, scrive e sposta una coppia di simboli
+set_tape 10 0110110
+head_position 10
+
+; <S> <R1R2> <D> <W1W2> <M1M2>, '-' legge qualsiasi simbolo, riscrive quello
+; letto o lascia la testina ferma
++ $ 0_ $ 00 >> ; copio
++ $ 1_ $ 11 >>
++ $ __ back __ << ; fine dell'input
++ back 0- back -- <- ; torno all'inizio del primo nastro
++ back 1- back -- <-
++ back _- cmp -- >-
++ cmp 00 cmp -- >< ; confronto
++ cmp 11 cmp -- ><
++ cmp 01 ! N- --
++ cmp 10 ! N- --
++ cmp __ ! Y- --
+
+run
+ps
@@ -0,0 +1,338 @@
+#include "lockstep_runner.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAS_SIMD_KERNELS
+#endif
+
+const long lockstep_runner::INTERRUPT_CHECK_INTERVAL = 1 << 16;
+
+typedef lockstep_runner::lane_set lane_set;
+typedef lockstep_runner::table_view table_view;
+
+/*
+ * A kernel runs at most n iterations of the active lanes, whose heads are
+ * all on their tapes. In every iteration each lane executes one step,
+ * flagged in `out` if it moves the head off the tape, keeping the state it
+ * started from, or else in `stopped` if the transition taken stops the
+ * machine. Returns the number of iterations run, stopping after the first
+ * one that flags a lane.
+ */
+typedef long (*kernel)(const table_view& t, lane_set& lanes, long n, uint32_t& out, uint32_t& stopped);
+
+template <bool compact>
+static long run_scalar(const table_view &t, lane_set &lanes, long n, uint32_t &out, uint32_t &stopped)
+{
+	for (long j = 0; j < n; j++) {
+		uint32_t o = 0, s = 0;
+		for (int i = 0; i < lockstep_runner::LANES; i++) {
+			if (!(lanes.active >> i & 1))
+				continue;
+			unsigned char c = static_cast<unsigned char>(lanes.tape[lanes.head[i]]);
+			transition_table::cell next = compact
+				? t.cells[(lanes.state[i] << t.row_shift) | t.column[c]] ^ t.keep[c]
+				: t.cells[lanes.state[i] * transition_table::SYMBOLS + c];
+			lanes.tape[lanes.head[i]] = transition_table::write_symbol(next);
+			lanes.head[i] += transition_table::head_delta(next);
+			lanes.cell[i] = next;
+			int32_t pos = lanes.head[i] - lanes.base[i];
+			if (pos < 0 || pos >= lanes.size) {
+				o |= 1u << i;
+				continue;
+			}
+			lanes.state[i] = transition_table::next_state(next);
+			if (transition_table::is_stop(next))
+				s |= 1u << i;
+		}
+		if (o != 0 || s != 0) {
+			out = o;
+			stopped = s;
+			return j + 1;
+		}
+	}
+	return n;
+}
+
+#ifdef HAS_SIMD_KERNELS
+
+// two vectors of 8 lanes, tape writes are scalar as AVX2 has no scatter
+template <bool compact>
+__attribute__((target("avx2")))
+static long run_avx2(const table_view &t, lane_set &lanes, long n, uint32_t &out, uint32_t &stopped)
+{
+	const int *tape = reinterpret_cast<const int *>(lanes.tape);
+	const int *cells = reinterpret_cast<const int *>(t.cells);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i symbol_mask = _mm256_set1_epi32(0xff);
+	const __m256i last = _mm256_set1_epi32(lanes.size - 1);
+	const __m256i stop = _mm256_set1_epi32(0x80);
+	const __m256i delta_mask = _mm256_set1_epi32(3);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m128i row_shift = _mm_cvtsi32_si128(t.row_shift);
+
+	__m256i head[2], base[2], state[2], cell[2], active[2];
+	for (int k = 0; k < 2; k++) {
+		head[k] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes.head + 8 * k));
+		base[k] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes.base + 8 * k));
+		state[k] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes.state + 8 * k));
+		cell[k] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes.cell + 8 * k));
+		__m256i bits = _mm256_and_si256(_mm256_set1_epi32(lanes.active >> (8 * k)), lane_bit);
+		active[k] = _mm256_cmpeq_epi32(bits, lane_bit);
+	}
+
+	alignas(32) int32_t heads[8];
+	alignas(32) int32_t writes[8];
+	long j = 0;
+	uint32_t o = 0, s = 0;
+	while (j < n && o == 0 && s == 0) {
+		for (int k = 0; k < 2; k++) {
+			__m256i go = active[k];
+
+			__m256i symbol = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, tape, head[k], go, 1), symbol_mask);
+			__m256i index;
+			if (compact) {
+				__m256i column = _mm256_mask_i32gather_epi32(zero, t.column, symbol, go, 4);
+				index = _mm256_or_si256(_mm256_sll_epi32(state[k], row_shift), column);
+			} else {
+				index = _mm256_or_si256(_mm256_slli_epi32(state[k], 7), symbol);
+			}
+			__m256i next = _mm256_mask_i32gather_epi32(zero, cells, index, go, 4);
+			if (compact)
+				next = _mm256_xor_si256(next, _mm256_mask_i32gather_epi32(zero, t.keep, symbol, go, 4));
+
+			_mm256_store_si256(reinterpret_cast<__m256i *>(heads), head[k]);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(writes), next);
+			for (int m = _mm256_movemask_ps(_mm256_castsi256_ps(go)); m != 0; m &= m - 1) {
+				int i = __builtin_ctz(m);
+				lanes.tape[heads[i]] = transition_table::write_symbol(writes[i]);
+			}
+
+			__m256i delta = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(next, 8), delta_mask), one);
+			head[k] = _mm256_add_epi32(head[k], _mm256_and_si256(delta, go));
+			__m256i pos = _mm256_sub_epi32(head[k], base[k]);
+			__m256i outside = _mm256_and_si256(_mm256_or_si256(_mm256_cmpgt_epi32(zero, pos),
+				_mm256_cmpgt_epi32(pos, last)), go);
+			__m256i moved = _mm256_andnot_si256(outside, go);
+			state[k] = _mm256_blendv_epi8(state[k], _mm256_srli_epi32(next, 10), moved);
+			cell[k] = _mm256_blendv_epi8(cell[k], next, go);
+
+			__m256i stops = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(next, stop), stop), moved);
+			o |= _mm256_movemask_ps(_mm256_castsi256_ps(outside)) << (8 * k);
+			s |= _mm256_movemask_ps(_mm256_castsi256_ps(stops)) << (8 * k);
+		}
+		j++;
+	}
+
+	for (int k = 0; k < 2; k++) {
+		_mm256_store_si256(reinterpret_cast<__m256i *>(lanes.head + 8 * k), head[k]);
+		_mm256_store_si256(reinterpret_cast<__m256i *>(lanes.state + 8 * k), state[k]);
+		_mm256_store_si256(reinterpret_cast<__m256i *>(lanes.cell + 8 * k), cell[k]);
+	}
+	out = o;
+	stopped = s;
+	return j;
+}
+
+// the unmasked AVX-512 intrinsics start from an undefined vector, which some
+// GCC versions report as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// one vector of 16 lanes, the tape cells are written back by scattering the
+// 4 bytes gathered with the cell read replaced
+template <bool compact>
+__attribute__((target("avx512f")))
+static long run_avx512(const table_view &t, lane_set &lanes, long n, uint32_t &out, uint32_t &stopped)
+{
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i symbol_mask = _mm512_set1_epi32(0xff);
+	const __m512i write_mask = _mm512_set1_epi32(0x7f);
+	const __m512i last = _mm512_set1_epi32(lanes.size - 1);
+	const __m512i stop = _mm512_set1_epi32(0x80);
+	const __m512i delta_mask = _mm512_set1_epi32(3);
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m128i row_shift = _mm_cvtsi32_si128(t.row_shift);
+
+	__m512i head = _mm512_load_si512(lanes.head);
+	__m512i base = _mm512_load_si512(lanes.base);
+	__m512i state = _mm512_load_si512(lanes.state);
+	__m512i cell = _mm512_load_si512(lanes.cell);
+	__mmask16 active = static_cast<__mmask16>(lanes.active);
+
+	long j = 0;
+	__mmask16 o = 0, s = 0;
+	while (j < n && o == 0 && s == 0) {
+		__mmask16 go = active;
+
+		__m512i word = _mm512_mask_i32gather_epi32(zero, go, head, lanes.tape, 1);
+		__m512i symbol = _mm512_and_si512(word, symbol_mask);
+		__m512i index;
+		if (compact) {
+			__m512i column = _mm512_mask_i32gather_epi32(zero, go, symbol, t.column, 4);
+			index = _mm512_or_si512(_mm512_sll_epi32(state, row_shift), column);
+		} else {
+			index = _mm512_or_si512(_mm512_slli_epi32(state, 7), symbol);
+		}
+		__m512i next = _mm512_mask_i32gather_epi32(zero, go, index, t.cells, 4);
+		if (compact)
+			next = _mm512_xor_si512(next, _mm512_mask_i32gather_epi32(zero, go, symbol, t.keep, 4));
+
+		word = _mm512_or_si512(_mm512_andnot_si512(symbol_mask, word), _mm512_and_si512(next, write_mask));
+		_mm512_mask_i32scatter_epi32(lanes.tape, go, head, word, 1);
+
+		__m512i delta = _mm512_sub_epi32(_mm512_and_si512(_mm512_srli_epi32(next, 8), delta_mask), one);
+		head = _mm512_mask_add_epi32(head, go, head, delta);
+		__m512i pos = _mm512_sub_epi32(head, base);
+		o = (_mm512_cmplt_epi32_mask(pos, zero) | _mm512_cmpgt_epi32_mask(pos, last)) & go;
+		__mmask16 moved = go & ~o;
+		state = _mm512_mask_mov_epi32(state, moved, _mm512_srli_epi32(next, 10));
+		cell = _mm512_mask_mov_epi32(cell, go, next);
+		s = _mm512_mask_test_epi32_mask(moved, next, stop);
+		j++;
+	}
+
+	_mm512_store_si512(lanes.head, head);
+	_mm512_store_si512(lanes.state, state);
+	_mm512_store_si512(lanes.cell, cell);
+	out = o;
+	stopped = s;
+	return j;
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+static kernel select_kernel(bool compact)
+{
+#ifdef HAS_SIMD_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return compact ? run_avx512<true> : run_avx512<false>;
+	if (__builtin_cpu_supports("avx2"))
+		return compact ? run_avx2<true> : run_avx2<false>;
+#endif
+	return compact ? run_scalar<true> : run_scalar<false>;
+}
+
+lockstep_runner::lockstep_runner(const transition_table &table, long memory_size, char blank, long head,
+	uint32_t init_state)
+	: memory_size(memory_size), blank(blank), head(head), init_state(init_state)
+{
+	view.cells = table.get_cells();
+	view.row_shift = table.get_row_shift();
+	view.compact = table.is_compact();
+	for (int c = 0; c < transition_table::SYMBOLS; c++) {
+		view.column[c] = table.get_columns()[c];
+		view.keep[c] = view.compact && view.column[c] == 0 ? c : 0;
+	}
+}
+
+bool lockstep_runner::fits(long memory_size)
+{
+	return memory_size > 0 && (memory_size + PADDING) * LANES <= INT32_MAX;
+}
+
+void lockstep_runner::run(const std::vector<std::string> &inputs, size_t first, size_t last, long max_steps,
+	int window, const std::atomic<bool> *interrupt, std::vector<batch_result> &results) const
+{
+	kernel step = select_kernel(view.compact);
+	long stride = memory_size + PADDING;
+	std::vector<char> tapes(stride * LANES, blank);
+
+	lane_set lanes;
+	lanes.tape = tapes.data();
+	lanes.size = memory_size;
+	lanes.active = 0;
+	for (int i = 0; i < LANES; i++) {
+		lanes.base[i] = i * stride;
+		lanes.head[i] = lanes.base[i];
+		lanes.state[i] = init_state;
+		lanes.cell[i] = 0;
+	}
+
+	size_t input[LANES];
+	long start[LANES];
+	long iteration = 0;
+	size_t next = first;
+
+	auto finish = [&](int i, run_status status, long steps) {
+		long pos = lanes.head[i] - lanes.base[i];
+		long begin = std::max(pos - window, 0L);
+		long end = std::min(pos + window + 1, memory_size);
+		batch_result &r = results[input[i]];
+		r = { status, lanes.state[i], steps, "" };
+		if (begin < end)
+			r.window.assign(lanes.tape + lanes.base[i] + begin, end - begin);
+		lanes.active &= ~(1u << i);
+	};
+
+	// loads the next input that doesn't end before its first step
+	auto fill = [&](int i) {
+		while (next < last) {
+			input[i] = next++;
+			const std::string &s = inputs[input[i]];
+			char *cells = lanes.tape + lanes.base[i];
+			std::fill(cells, cells + memory_size, blank);
+			if (!s.empty() && (head < 0 || head + static_cast<long>(s.size()) > memory_size))
+				throw std::runtime_error("Position out of tape");
+			std::copy(s.begin(), s.end(), cells + head);
+
+			lanes.head[i] = lanes.base[i] + head;
+			lanes.state[i] = init_state;
+			start[i] = iteration;
+			lanes.active |= 1u << i;
+			if (head < 0 || head >= memory_size)
+				finish(i, run_status::out_of_memory, 0);
+			else if (max_steps == 0)
+				finish(i, run_status::step_limit, 0);
+			else if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed))
+				finish(i, run_status::interrupted, 0);
+			else
+				return;
+		}
+	};
+
+	for (int i = 0; i < LANES; i++)
+		fill(i);
+
+	while (lanes.active != 0) {
+		// iterations till the first lane reaches the step limit
+		long n = INTERRUPT_CHECK_INTERVAL;
+		for (int i = 0; i < LANES; i++)
+			if (max_steps >= 0 && (lanes.active >> i & 1))
+				n = std::min(n, start[i] + max_steps - iteration);
+
+		uint32_t out = 0, stopped = 0;
+		iteration += step(view, lanes, n, out, stopped);
+
+		uint32_t finished = 0;
+		for (int i = 0; i < LANES; i++) {
+			uint32_t bit = 1u << i;
+			if (!(lanes.active & bit))
+				continue;
+			if (out & bit) {
+				finish(i, run_status::out_of_memory, iteration - start[i]);
+			} else if (stopped & bit) {
+				finish(i, transition_table::is_defined(lanes.cell[i]) ? run_status::halted
+					: run_status::illegal_instruction, iteration - start[i]);
+			} else if (max_steps >= 0 && iteration - start[i] == max_steps) {
+				finish(i, run_status::step_limit, max_steps);
+			} else if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+				finish(i, run_status::interrupted, iteration - start[i]);
+			} else {
+				continue;
+			}
+			finished |= bit;
+		}
+
+		for (int i = 0; i < LANES; i++)
+			if (finished >> i & 1)
+				fill(i);
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef LOCKSTEP_RUNNER_H
+#define LOCKSTEP_RUNNER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transition_table.hpp"
+#include "batch_runner.hpp"
+
+/*
+ * Runs LANES inputs of the same program at once on fixed size tapes, one
+ * step of every lane per iteration. States, heads and tapes are kept in
+ * structure of arrays form so the reads of the tapes and the lookups in the
+ * table are vector gathers, with AVX-512 or AVX2 when the processor has them
+ * and a scalar loop otherwise. A lane that stops is refilled with the next
+ * input right away, so the vectors stay full till the inputs run out.
+ *
+ * Gives the same results as running each input with batch_runner::run_one
+ * on a fixed tape.
+ */
+class lockstep_runner {
+public:
+	static const int LANES = 16;
+
+	// the lanes of a group and their tapes, lane i holds its cells at
+	// tape[base[i], base[i] + size)
+	struct lane_set {
+		char *tape;
+		int32_t size;
+		uint32_t active;		// bit i set while lane i runs an input
+		alignas(64) int32_t head[LANES];	// offset of the head cell in tape
+		alignas(64) int32_t base[LANES];
+		alignas(64) uint32_t state[LANES];
+		alignas(64) uint32_t cell[LANES];	// last transition taken
+	};
+
+	// the table as the kernels read it
+	struct table_view {
+		const transition_table::cell *cells;
+		int row_shift;
+		bool compact;
+		alignas(64) int32_t column[transition_table::SYMBOLS];
+		alignas(64) int32_t keep[transition_table::SYMBOLS];
+	};
+
+private:
+	static const long INTERRUPT_CHECK_INTERVAL;
+	// cells after each tape read and rewritten by the 4 byte gathers
+	static const int32_t PADDING = 4;
+
+	table_view view;
+	long memory_size;
+	char blank;
+	long head;
+	uint32_t init_state;
+
+public:
+	lockstep_runner(const transition_table& table, long memory_size, char blank, long head, uint32_t init_state);
+
+	// true if the tapes of a group of lanes can be addressed
+	static bool fits(long memory_size);
+
+	// runs inputs [first, last) writing their results at the same index
+	void run(const std::vector<std::string>& inputs, size_t first, size_t last, long max_steps, int window,
+		const std::atomic<bool> *interrupt, std::vector<batch_result>& results) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "machine_runner.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// steps between two snapshots, a few milliseconds of work on the table engine
+const long machine_runner::SLICE_STEPS = 1 << 20;
+
+void machine_snapshot::take(const turing_machine &tm)
+{
+	const std::string &name = tm.get_current_state();
+	size_t n = std::min(name.size(), static_cast<size_t>(MAX_STATE_NAME - 1));
+	name.copy(state, n);
+	state[n] = '\0';
+
+	steps = tm.get_computation_steps();
+	tape_count = tm.get_tape_count();
+	for (int t = 0; t < tape_count; t++)
+		tapes[t].take(tm, t);
+}
+
+void machine_snapshot::tape_view::take(const turing_machine &tm, int tape)
+{
+	head_pos = tm.get_head_pos(tape);
+	tape_begin = tm.get_tape_begin(tape);
+	tape_length = tm.get_tape_length(tape);
+
+	long begin = std::max(head_pos - MAX_CELLS / 2, tape_begin);
+	long end = std::min(begin + MAX_CELLS, tape_begin + tape_length);
+	cells_begin = begin;
+	cells_size = begin < end ? static_cast<int>(end - begin) : 0;
+	if (cells_size > 0) {
+		std::string range = tm.get_tape_range(begin, end, tape);
+		range.copy(cells, cells_size);
+	}
+}
+
+std::string machine_snapshot::tape_view::get_range(long begin, long end) const
+{
+	std::string result;
+	for (long i = begin; i < end; i++)
+		result += i >= cells_begin && i < cells_begin + cells_size ? cells[i - cells_begin] : ' ';
+	return result;
+}
+
+machine_runner::machine_runner(turing_machine &tm)
+	: tm(tm)
+{
+}
+
+machine_runner::~machine_runner()
+{
+	stop();
+}
+
+void machine_runner::start()
+{
+	if (worker.joinable())
+		throw std::runtime_error("The machine is already running");
+
+	machine_snapshot s;
+	s.take(tm);
+	s.status = run_status::step_limit;
+	s.running = true;
+	snapshot.store(s);
+
+	interrupt = false;
+	error.clear();
+	worker = std::thread(&machine_runner::work, this);
+}
+
+void machine_runner::work()
+{
+	machine_snapshot s;
+	run_status status = run_status::step_limit;
+	try {
+		tm.check_runnable();
+		while (status == run_status::step_limit) {
+			status = tm.run(SLICE_STEPS, &interrupt);
+			if (status == run_status::step_limit && interrupt.load(std::memory_order_relaxed))
+				status = run_status::interrupted;
+
+			s.take(tm);
+			s.status = status;
+			s.running = status == run_status::step_limit;
+			snapshot.store(s);
+		}
+	} catch (const std::exception &e) {
+		error = e.what();
+		s.take(tm);
+		s.status = run_status::illegal_instruction;
+		s.running = false;
+		snapshot.store(s);
+	}
+}
+
+void machine_runner::stop()
+{
+	if (!worker.joinable())
+		return;
+	interrupt = true;
+	worker.join();
+}
+
+bool machine_runner::is_started() const
+{
+	return worker.joinable();
+}
+
+void machine_runner::read(machine_snapshot &s) const
+{
+	snapshot.load(s);
+}
+
+const std::string &machine_runner::get_error() const
+{
+	return error;
+}
@@ -0,0 +1,105 @@
+#ifndef MACHINE_RUNNER_H
+#define MACHINE_RUNNER_H
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "turing_machine.hpp"
+
+// the part of the machine shown by the GUI, plain data so it can be copied
+// under a seqlock
+struct machine_snapshot {
+	static const int MAX_CELLS = 512;
+	static const int MAX_STATE_NAME = 64;
+
+	struct tape_view {
+		long head_pos;
+		long tape_begin;
+		long tape_length;
+		long cells_begin;	// tape position of cells[0]
+		int cells_size;
+		char cells[MAX_CELLS];	// tape around the head
+
+		void take(const turing_machine& tm, int tape);
+		// tape cells [begin, end), blanks outside the copied ones
+		std::string get_range(long begin, long end) const;
+	};
+
+	char state[MAX_STATE_NAME];
+	long steps;
+	int tape_count;
+	tape_view tapes[tuple_table::MAX_TAPES];
+	run_status status;
+	bool running;
+
+	void take(const turing_machine& tm);
+};
+
+/*
+ * Single writer seqlock: the writer bumps the sequence to odd, copies and
+ * bumps it back to even, readers retry while it is odd or changed during
+ * their copy. Neither side ever blocks.
+ */
+template <typename T>
+class seqlock {
+	std::atomic<unsigned> sequence{0};
+	T data;
+
+public:
+	void store(const T& value)
+	{
+		unsigned s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(static_cast<void *>(&data), &value, sizeof(T));
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	void load(T& value) const
+	{
+		unsigned before, after;
+		do {
+			before = sequence.load(std::memory_order_acquire);
+			std::memcpy(static_cast<void *>(&value), &data, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence.load(std::memory_order_relaxed);
+		} while (before != after || (before & 1) != 0);
+	}
+};
+
+/*
+ * Runs the machine on a worker thread at full speed, publishing a snapshot
+ * every SLICE_STEPS steps for the GUI to draw at its own pace. The machine
+ * must not be touched by anyone else till stop() returns or a snapshot says
+ * it isn't running anymore.
+ */
+class machine_runner {
+	static const long SLICE_STEPS;
+
+	turing_machine &tm;
+	std::thread worker;
+	std::atomic<bool> interrupt{false};
+	seqlock<machine_snapshot> snapshot;
+	std::string error;
+
+	void work();
+
+public:
+	explicit machine_runner(turing_machine& tm);
+	~machine_runner();
+	machine_runner(const machine_runner&) = delete;
+	machine_runner& operator=(const machine_runner&) = delete;
+
+	void start();
+	// interrupts the run and waits for the worker, does nothing if not started
+	void stop();
+	bool is_started() const;
+
+	void read(machine_snapshot& s) const;
+	// message of the exception that ended the last run, empty if none
+	const std::string& get_error() const;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "macro_machine.hpp"
+
+#include <algorithm>
+#include <climits>
+
+// padding of the last block of a bounded tape, the head reaching it has left the tape
+const char macro_machine::WALL = '\0';
+const long macro_machine::BLANK_CHUNK = 1L << 20;
+const long macro_machine::INTERRUPT_CHECK_INTERVAL = 4096;
+
+macro_machine::macro_machine(const transition_table &table, int block_size)
+	: table(table), k(block_size), block_limit(static_cast<long>(block_size) << 16)
+{
+}
+
+size_t macro_machine::get_cache_size() const
+{
+	return cache.size();
+}
+
+macro_machine::transition macro_machine::simulate(uint32_t state, std::string block, int offset) const
+{
+	transition t = { "", state, 0, offset, 0, run_status::step_limit, state };
+
+	while (t.steps < block_limit) {
+		if (block[offset] == WALL) {
+			t.status = run_status::out_of_memory;
+			break;
+		}
+
+		transition_table::cell next = table.get_cell(state, block[offset]);
+		t.steps++;
+		if (!transition_table::is_defined(next)) {
+			t.status = run_status::illegal_instruction;
+			break;
+		}
+
+		block[offset] = transition_table::write_symbol(next);
+		offset += transition_table::head_delta(next);
+		t.from = state;
+		// off the tape the machine stays in the state it was
+		if (offset >= 0 && offset < k && block[offset] == WALL) {
+			t.status = run_status::out_of_memory;
+			break;
+		}
+		state = transition_table::next_state(next);
+
+		if (transition_table::is_stop(next)) {
+			t.status = run_status::halted;
+			break;
+		}
+		if (offset < 0 || offset >= k) {
+			t.exit = offset < 0 ? -1 : 1;
+			break;
+		}
+	}
+
+	t.block = block;
+	t.state = state;
+	t.offset = offset;
+	return t;
+}
+
+const macro_machine::transition &macro_machine::lookup(uint32_t state, const std::string &block, int offset)
+{
+	std::string key(reinterpret_cast<const char *>(&state), sizeof(state));
+	key += offset == 0 ? 'L' : 'R';
+	key += block;
+
+	auto it = cache.find(key);
+	if (it == cache.end())
+		it = cache.emplace(key, simulate(state, block, offset)).first;
+	return it->second;
+}
+
+void macro_machine::push(std::vector<block_run> &stack, const std::string &block, long count)
+{
+	if (!stack.empty() && stack.back().block == block)
+		stack.back().count += count;
+	else
+		stack.push_back({ block, count });
+}
+
+void macro_machine::pop(std::vector<block_run> &stack, long count)
+{
+	stack.back().count -= count;
+	if (stack.back().count == 0)
+		stack.pop_back();
+}
+
+run_status macro_machine::run(tape_storage &tape, bool bounded, long &head, uint32_t &state, long &steps,
+	long max_steps, const std::atomic<bool> *interrupt)
+{
+	const char blank = tape.get_blank();
+	const std::string blank_block(k, blank);
+
+	long lo = tape.get_begin();
+	long hi = tape.get_end();
+	if (!bounded) {
+		lo = std::min(lo, head);
+		hi = std::max(hi, head + 1);
+	}
+	if (head < lo || head >= hi)
+		return run_status::out_of_memory;
+
+	// encode the tape in blocks, padding the last one
+	std::vector<block_run> runs;
+	std::string block;
+	for (long pos = lo; pos < hi; ) {
+		const char *cells = nullptr;
+		long n;
+		if (pos >= tape.get_begin() && pos < tape.get_end())
+			n = std::min(tape.view(pos, cells), hi - pos);
+		else
+			n = (pos < tape.get_begin() ? tape.get_begin() : hi) - pos;
+
+		for (long i = 0; i < n; ) {
+			if (block.empty() && cells == nullptr && n - i >= k) {
+				long count = (n - i) / k;
+				push(runs, blank_block, count);
+				i += count * k;
+				continue;
+			}
+			block += cells != nullptr ? cells[i] : blank;
+			i++;
+			if (static_cast<int>(block.size()) == k) {
+				push(runs, block, 1);
+				block.clear();
+			}
+		}
+		pos += n;
+	}
+	if (!block.empty()) {
+		block.resize(k, bounded ? WALL : blank);
+		push(runs, block, 1);
+	}
+
+	// split the runs around the block under the head
+	std::vector<block_run> left, right;
+	long block_pos = lo + (head - lo) / k * k;
+	int offset = (head - lo) % k;
+	long pos = lo;
+	for (const block_run &r : runs) {
+		long end = pos + r.count * k;
+		if (end <= block_pos) {
+			left.push_back(r);
+		} else if (pos >= block_pos) {
+			right.push_back(r);
+		} else {
+			left.push_back({ r.block, (block_pos - pos) / k });
+			right.push_back({ r.block, (end - block_pos) / k });
+			if (left.back().count == 0)
+				left.pop_back();
+		}
+		pos = end;
+	}
+	std::reverse(right.begin(), right.end());
+
+	run_status status = run_status::step_limit;
+	bool outside = false;
+	long iterations = 0;
+
+	while (max_steps < 0 || steps < max_steps) {
+		long remaining = max_steps < 0 ? LONG_MAX : max_steps - steps;
+		const std::string current = right.back().block;
+
+		// only blocks entered from a side are worth memoizing
+		transition uncached;
+		const transition *t = &uncached;
+		if (offset == 0 || offset == k - 1)
+			t = &lookup(state, current, offset);
+		else
+			uncached = simulate(state, current, offset);
+
+		// looping inside the block or not enough budget for the whole block
+		if ((t->exit == 0 && t->status == run_status::step_limit) || t->steps > remaining)
+			break;
+
+		if (t->exit == 0) {
+			// a halting step can still leave the tape from the first or last block
+			bool edge = bounded && ((t->offset < 0 && left.empty())
+				|| (t->offset >= k && right.size() == 1 && right.back().count == 1));
+			pop(right, 1);
+			push(right, t->block, 1);
+			offset = t->offset;
+			state = edge ? t->from : t->state;
+			steps += t->steps;
+			status = edge ? run_status::out_of_memory : t->status;
+			break;
+		}
+
+		long count = 1;
+		if (t->exit > 0) {
+			// a block entered from the left and left on the right in the same
+			// state: all the equal blocks that follow behave the same way
+			if (t->state == state && offset == 0)
+				count = std::min(right.back().count, remaining / t->steps);
+			pop(right, count);
+			push(left, t->block, count);
+			block_pos += count * k;
+			offset = 0;
+			if (right.empty()) {
+				if (bounded)
+					outside = true;
+				else
+					right.push_back({ blank_block, BLANK_CHUNK });
+			}
+		} else {
+			pop(right, 1);
+			if (t->state == state && offset == k - 1 && !left.empty() && left.back().block == current) {
+				count += std::min(left.back().count, remaining / t->steps - 1);
+				pop(left, count - 1);
+			}
+			push(right, t->block, count);
+			block_pos -= count * k;
+			offset = k - 1;
+			if (left.empty()) {
+				if (bounded) {
+					outside = true;
+				} else {
+					left.push_back({ blank_block, BLANK_CHUNK });
+					lo -= BLANK_CHUNK * k;
+				}
+			}
+			if (!outside) {
+				push(right, left.back().block, 1);
+				pop(left, 1);
+			}
+		}
+		steps += count * t->steps;
+		state = outside ? t->from : t->state;
+
+		if (outside) {
+			status = run_status::out_of_memory;
+			break;
+		}
+		if (++iterations % INTERRUPT_CHECK_INTERVAL == 0 && interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+			status = run_status::interrupted;
+			break;
+		}
+	}
+
+	// decode the blocks back on the tape
+	pos = lo;
+	auto emit = [&](const block_run &r) {
+		long end = pos + r.count * k;
+		if (r.block == blank_block) {
+			long b = bounded ? pos : std::max(pos, tape.get_begin());
+			long e = bounded ? end : std::min(end, tape.get_end());
+			if (b < e)
+				tape.fill(b, e, blank);
+		} else {
+			for (long p = pos; p < end; p++)
+				if (r.block[(p - pos) % k] != WALL)
+					tape.set(p, r.block[(p - pos) % k]);
+		}
+		pos = end;
+	};
+	for (const block_run &r : left)
+		emit(r);
+	for (auto r = right.rbegin(); r != right.rend(); ++r)
+		emit(*r);
+
+	head = block_pos + offset;
+	return status;
+}
@@ -0,0 +1,65 @@
+#ifndef MACRO_MACHINE_H
+#define MACRO_MACHINE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+
+/*
+ * Macro machine simulation: the tape is split in blocks of k cells and the
+ * machine is run one block at a time. The effect of entering a block from
+ * one side in a given state is computed once and memoized, and the block
+ * tape is kept as runs of equal blocks so a state crossing a whole run the
+ * same way is applied to all of it at once.
+ */
+class macro_machine {
+public:
+	macro_machine(const transition_table& table, int block_size);
+
+	// runs the machine on tape until it stops, the budget is exhausted or the
+	// machine loops forever inside a block. In the last case it returns
+	// step_limit with steps < max_steps and the caller should fall back to
+	// plain stepping.
+	run_status run(tape_storage& tape, bool bounded, long& head, uint32_t& state, long& steps,
+		long max_steps, const std::atomic<bool> *interrupt);
+
+	size_t get_cache_size() const;
+
+private:
+	static const char WALL;
+	static const long BLANK_CHUNK;
+	static const long INTERRUPT_CHECK_INTERVAL;
+
+	struct block_run {
+		std::string block;
+		long count;
+	};
+
+	// outcome of running inside a single block
+	struct transition {
+		std::string block;
+		uint32_t state;
+		int exit;	// -1 left, +1 right, 0 stopped inside the block
+		int offset;	// head offset when stopped inside the block
+		long steps;
+		run_status status;
+		uint32_t from;	// state before the last step
+	};
+
+	const transition_table& table;
+	const int k;
+	const long block_limit;
+	std::unordered_map<std::string, transition> cache;
+
+	transition simulate(uint32_t state, std::string block, int offset) const;
+	const transition& lookup(uint32_t state, const std::string& block, int offset);
+
+	static void push(std::vector<block_run>& stack, const std::string& block, long count);
+	static void pop(std::vector<block_run>& stack, long count);
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "native_program.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define HAS_NATIVE
+#endif
+
+// status codes returned by the generated function
+enum { NATIVE_RUNNING, NATIVE_HALTED, NATIVE_ILLEGAL };
+
+static uint64_t fnv1a(const std::string &s)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned char c : s) {
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+#ifdef HAS_NATIVE
+
+// the cached objects are loaded without being rebuilt, so the directory
+// must be private to the user: created 0700 and refused if someone else
+// owns it, it is a link or others can write in it
+static std::string cache_directory()
+{
+	std::string dir;
+	const char *env = getenv("TM_CACHE_DIR");
+	if (env != nullptr && *env != '\0') {
+		dir = env;
+	} else {
+		const char *xdg = getenv("XDG_CACHE_HOME");
+		const char *home = getenv("HOME");
+		if (xdg != nullptr && *xdg != '\0') {
+			dir = xdg;
+		} else if (home != nullptr && *home != '\0') {
+			dir = std::string(home) + "/.cache";
+		} else {
+			throw std::runtime_error("No cache directory for compiled programs, set TM_CACHE_DIR");
+		}
+		mkdir(dir.c_str(), 0700);
+		dir += "/tm";
+	}
+	mkdir(dir.c_str(), 0700);
+
+	struct stat st;
+	if (lstat(dir.c_str(), &st) != 0)
+		throw std::runtime_error("Cannot create cache directory " + dir);
+	if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+		throw std::runtime_error("Unsafe cache directory " + dir + ": it must be a directory owned by the user and not writable by others");
+	return dir;
+}
+
+// runs the command without a shell, true if it exits with status 0
+static bool run_command(const std::vector<std::string> &args)
+{
+	std::vector<char *> argv;
+	for (const std::string &a : args)
+		argv.push_back(const_cast<char *>(a.c_str()));
+	argv.push_back(nullptr);
+
+	pid_t pid = fork();
+	if (pid < 0)
+		return false;
+	if (pid == 0) {
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif
+
+std::string native_program::generate(const transition_table &table)
+{
+	typedef std::tuple<bool, bool, int, int, uint32_t, bool> action;
+
+	std::ostringstream out;
+	size_t states = table.get_states();
+
+	out << "// generated by TM, do not edit\n"
+		<< "#include <stdint.h>\n\n"
+		<< "extern \"C\" long tm_execute(char *t, long *head, uint32_t *state, long n, int *status)\n"
+		<< "{\n"
+		<< "\tlong h = *head;\n"
+		<< "\tlong steps = 0;\n"
+		<< "\tuint32_t s = *state;\n"
+		<< "\t*status = " << NATIVE_RUNNING << ";\n"
+		<< "\tswitch (s) {\n";
+	for (size_t s = 0; s < states; s++)
+		out << "\tcase " << s << ": goto s" << s << ";\n";
+	out << "\tdefault: *status = " << NATIVE_ILLEGAL << "; return 0;\n"
+		<< "\t}\n";
+
+	for (size_t s = 0; s < states; s++) {
+		// group the symbols with the same action, writes of the symbol read are dropped
+		std::map<action, std::vector<int> > groups;
+		for (int c = 0; c < transition_table::SYMBOLS; c++) {
+			transition_table::cell cell = table.get_cell(s, static_cast<char>(c));
+			bool defined = transition_table::is_defined(cell);
+			bool keep = !defined || transition_table::write_symbol(cell) == c;
+			groups[action(defined, keep, keep ? 0 : transition_table::write_symbol(cell),
+				transition_table::head_delta(cell), transition_table::next_state(cell),
+				transition_table::is_stop(cell))].push_back(c);
+		}
+
+		auto largest = groups.begin();
+		for (auto g = groups.begin(); g != groups.end(); ++g)
+			if (g->second.size() > largest->second.size())
+				largest = g;
+
+		out << "s" << s << ":\n"
+			<< "\tif (steps == n) { s = " << s << "; goto out; }\n"
+			<< "\tsteps++;\n"
+			<< "\tswitch (static_cast<unsigned char>(t[h])) {\n";
+		for (auto g = groups.begin(); g != groups.end(); ++g) {
+			if (g == largest) {
+				out << "\tdefault:\n";
+			} else {
+				out << "\t";
+				for (int c : g->second)
+					out << "case " << c << ": ";
+				out << "\n";
+			}
+
+			bool defined, keep, stop;
+			int write, delta;
+			uint32_t next;
+			std::tie(defined, keep, write, delta, next, stop) = g->first;
+			if (!defined) {
+				out << "\t\ts = " << s << "; *status = " << NATIVE_ILLEGAL << "; goto out;\n";
+				continue;
+			}
+			out << "\t\t";
+			if (!keep)
+				out << "t[h] = " << write << "; ";
+			out << "h += " << delta << "; ";
+			if (stop)
+				out << "s = " << next << "; *status = " << NATIVE_HALTED << "; goto out;\n";
+			else
+				out << "goto s" << next << ";\n";
+		}
+		out << "\t}\n";
+	}
+
+	out << "out:\n"
+		<< "\t*head = h;\n"
+		<< "\t*state = s;\n"
+		<< "\treturn steps;\n"
+		<< "}\n";
+	return out.str();
+}
+
+#ifdef HAS_NATIVE
+
+native_program::native_program(void *handle, function fn, const std::string &path, bool cached)
+	: handle(handle), execute_fn(fn), path(path), cached(cached)
+{
+}
+
+native_program::~native_program()
+{
+	dlclose(handle);
+}
+
+std::unique_ptr<native_program> native_program::compile(const transition_table &table)
+{
+	std::string source = generate(table);
+	std::string dir = cache_directory();
+
+	char name[32];
+	snprintf(name, sizeof(name), "tm_%016llx", static_cast<unsigned long long>(fnv1a(source)));
+	std::string base = dir + "/" + name;
+	std::string object = base + ".so";
+
+	bool cached = access(object.c_str(), R_OK) == 0;
+	if (!cached) {
+		// source and object are written to temporary files and renamed, so
+		// concurrent processes never see a partial one
+		std::string suffix = "." + std::to_string(getpid());
+		std::string source_path = base + ".cpp";
+		std::ofstream out(source_path + suffix);
+		if (!out.is_open())
+			throw std::runtime_error("Cannot write " + source_path);
+		out << source;
+		out.close();
+		if (!out || rename((source_path + suffix).c_str(), source_path.c_str()) != 0) {
+			unlink((source_path + suffix).c_str());
+			throw std::runtime_error("Cannot write " + source_path);
+		}
+
+		// $CXX may hold a launcher and flags, split on blanks as a shell would
+		std::vector<std::string> args;
+		const char *cxx = getenv("CXX");
+		std::istringstream words(cxx != nullptr && *cxx != '\0' ? cxx : "c++");
+		for (std::string word; words >> word; )
+			args.push_back(word);
+		std::string tmp = object + suffix;
+		for (const char *arg : {"-O2", "-shared", "-fPIC", "-o"})
+			args.push_back(arg);
+		args.push_back(tmp);
+		args.push_back(source_path);
+
+		if (!run_command(args) || rename(tmp.c_str(), object.c_str()) != 0) {
+			unlink(tmp.c_str());
+			std::string command;
+			for (const std::string &a : args)
+				command += (command.empty() ? "" : " ") + a;
+			throw std::runtime_error("Native compilation failed: " + command);
+		}
+	}
+
+	void *handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == nullptr)
+		throw std::runtime_error(std::string("Cannot load compiled program: ") + dlerror());
+
+	function fn = reinterpret_cast<function>(dlsym(handle, "tm_execute"));
+	if (fn == nullptr) {
+		dlclose(handle);
+		throw std::runtime_error("Compiled program has no entry point");
+	}
+
+	return std::unique_ptr<native_program>(new native_program(handle, fn, object, cached));
+}
+
+#else
+
+native_program::native_program(void *handle, function fn, const std::string &path, bool cached)
+	: handle(handle), execute_fn(fn), path(path), cached(cached)
+{
+}
+
+native_program::~native_program()
+{
+}
+
+std::unique_ptr<native_program> native_program::compile(const transition_table & /* unused */)
+{
+	throw std::runtime_error("Native compilation is not supported on this platform");
+}
+
+#endif
+
+long native_program::execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+{
+	int code;
+	long steps = execute_fn(tape, &head, &state, n, &code);
+	switch (code) {
+		case NATIVE_HALTED: status = run_status::halted; break;
+		case NATIVE_ILLEGAL: status = run_status::illegal_instruction; break;
+		default: status = run_status::step_limit; break;
+	}
+	return steps;
+}
+
+const std::string &native_program::get_path() const
+{
+	return path;
+}
+
+bool native_program::is_cached() const
+{
+	return cached;
+}
@@ -0,0 +1,40 @@
+#ifndef NATIVE_PROGRAM_H
+#define NATIVE_PROGRAM_H
+
+#include <string>
+#include <memory>
+
+#include "transition_table.hpp"
+
+/*
+ * A program translated to C++ (one label per state, a switch on the symbol
+ * read and direct gotos between states), compiled by the system compiler
+ * into a shared object and loaded with dlopen. Compiled objects are cached
+ * on disk by the hash of the generated source.
+ */
+class native_program {
+	typedef long (*function)(char *tape, long *head, uint32_t *state, long n, int *status);
+
+	void *handle;
+	function execute_fn;
+	std::string path;
+	bool cached;
+
+	native_program(void *handle, function fn, const std::string& path, bool cached);
+
+public:
+	~native_program();
+	native_program(const native_program&) = delete;
+	native_program& operator=(const native_program&) = delete;
+
+	static std::unique_ptr<native_program> compile(const transition_table& table);
+	static std::string generate(const transition_table& table);
+
+	// same contract as transition_table::execute
+	long execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const;
+
+	const std::string& get_path() const;
+	bool is_cached() const;
+};
+
+#endif
@@ -1,141 +1,182 @@
+#include <algorithm>
 #include <stdexcept> 
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <chrono>
 
 #include "ncurses_gui.hpp"
 #include "turing_machine.hpp"
 #include "ncurses_wrapper.hpp"
 #include "command_line.hpp"
+#include "machine_runner.hpp"
 
 const std::string TITLE = "Turing Machine simulator";
+// screen updates per second while the machine runs in the background
+const int FRAME_RATE = 30;
+// rows of a tape window, the tapes are stacked under the title
+const int TAPE_HEIGHT = 4;
 
 class tape_window : public ncurses::window {
 
-	const char *tape;
 	long head_pos;
 	long window_start;
+	long tape_begin;
 	long tape_length;
 	int start; 
 	int end;
 	int number_of_cells;
+	std::vector<ncurses::chtype> cells;	// row of the cells as on screen
+	int marker = -1;	// column of the head marker, -1 if not shown
 	const turing_machine &tm;
+	int tape;
 
-public:
+	static int symbol_column(int cell) { return 4 * cell + 2; }
 
-	tape_window(int height, int width, int starty, int startx, const turing_machine &tm) : 
-		window(height, width, starty, startx + ((width-1) % 4) + 1), number_of_cells((width-1)/4 - 1), tm(tm) 
+	// the borders of the cells never change, they are drawn once
+	void draw_frame()
 	{
-		update_tape();
+		using ncurses::charcode;
+		int length = 4 * number_of_cells + 1;
+		std::vector<ncurses::chtype> top(length), bottom(length);
+		cells.assign(length, ' ');
+		for (int i = 0; i < length; i++) {
+			bool edge = i % 4 == 0;
+			top[i] = ncurses::get_keycode(edge ? charcode::ACS_TTEE : charcode::ACS_HLINE);
+			bottom[i] = ncurses::get_keycode(edge ? charcode::ACS_BTEE : charcode::ACS_HLINE);
+			if (edge)
+				cells[i] = ncurses::get_keycode(charcode::ACS_VLINE);
+		}
+		top.front() = ncurses::get_keycode(charcode::ACS_ULCORNER);
+		top.back() = ncurses::get_keycode(charcode::ACS_URCORNER);
+		bottom.front() = ncurses::get_keycode(charcode::ACS_LLCORNER);
+		bottom.back() = ncurses::get_keycode(charcode::ACS_LRCORNER);
+
+		addchstr(0, 0, top.data(), length);
+		addchstr(1, 0, cells.data(), length);
+		addchstr(2, 0, bottom.data(), length);
 	}
 
-	void refresh() 
+	// rewrites the span of cells that changed since the last call and moves the head marker
+	void draw(const std::string &tape)
 	{
-
-		move(0, 0);
-
-		addch(ncurses::charcode::ACS_ULCORNER);
-		for (int i = 1; i < number_of_cells; i++) {
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_TTEE);
+		std::vector<ncurses::chtype> row(cells);
+		for (int i = 0; i < number_of_cells; i++)
+			row[symbol_column(i)] = i >= start && i < end ? static_cast<unsigned char>(tape[i-start]) : ' ';
+
+		int first = 0, last = static_cast<int>(row.size());
+		while (first < last && row[first] == cells[first])
+			first++;
+		while (last > first && row[last-1] == cells[last-1])
+			last--;
+		if (first < last) {
+			addchstr(1, first, row.data() + first, last - first);
+			cells.swap(row);
 		}
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_URCORNER);
-
-		move(3, 0);
-		clrtoeol(); 
-
-		move(1, 0);
-		addch(ncurses::charcode::ACS_VLINE);
-		for (int i = 0; i < start; i++) {
-			addch(' ');
-			addch(' ');
-			addch(' ');
-			addch(ncurses::charcode::ACS_VLINE);
-		}
-		for (int i = start; i < end; i++) {
-			addch(' ');
-			//attron(COLOR_PAIR(1));
-			addch(tape[window_start+i-start]);
-			//attroff(COLOR_PAIR(1));
-			if (window_start+i-start == head_pos) {
-				move(3, getcurx() - 1);
-				addch('^');
-				move(1, getcurx());
-			}
-			addch(' ');
-			addch(ncurses::charcode::ACS_VLINE);
-		}
-		for (int i = end; i < number_of_cells; i++) {
-			addch(' ');
-			addch(' ');
-			addch(' ');
-			addch(ncurses::charcode::ACS_VLINE);
+
+		long cell = head_pos - window_start + start;
+		int column = cell >= start && cell < end ? symbol_column(cell) : -1;
+		if (column != marker) {
+			if (marker >= 0)
+				addstr(3, marker, " ", 1);
+			if (column >= 0)
+				addstr(3, column, "^", 1);
+			marker = column;
 		}
 
-		move(2, 0);
-		addch(ncurses::charcode::ACS_LLCORNER);
-		for (int i = 1; i < number_of_cells; i++) {
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_HLINE);
-			addch(ncurses::charcode::ACS_BTEE);
+		noutrefresh();
+	}
+
+	void place_window(long head, long begin, long length)
+	{
+		head_pos = head;
+		tape_begin = begin;
+		tape_length = length;
+
+		if (tape_length < number_of_cells) {
+			window_start = tape_begin;
+			start = (number_of_cells - tape_length) / 2;
+			end = start + tape_length;
+		} else {
+			window_start = head_pos - number_of_cells / 2;
+			if (window_start < tape_begin) 
+				window_start = tape_begin;
+			if (window_start + number_of_cells >= tape_begin + tape_length)
+				window_start = tape_begin + tape_length - number_of_cells;
+			start = 0;
+			end = number_of_cells;
 		}
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_HLINE);
-		addch(ncurses::charcode::ACS_LRCORNER);
+	}
+
+public:
 
-		window::refresh();
+	tape_window(int height, int width, int starty, int startx, const turing_machine &tm, int tape = 0) : 
+		window(height, width, starty, startx + ((width-1) % 4) + 1), number_of_cells((width-1)/4 - 1), tm(tm),
+		tape(tape)
+	{
+		draw_frame();
+		update_tape();
+	}
 
+	void refresh() 
+	{
+		draw(tm.get_tape_range(window_start, window_start + end - start, tape));
 	}
 
 	void scroll_left() 
 	{
-		if (window_start > 0)
+		if (window_start > tape_begin)
 			window_start--;
 		refresh();
 	}
 
 	void scroll_right() 
 	{
-		if (window_start < tape_length - number_of_cells - 1)
+		if (window_start < tape_begin + tape_length - number_of_cells - 1)
 			window_start++;
 		refresh();
 	}
 
 	void update_tape() 
 	{
-		tape = tm.get_tape_raw().c_str();
-		head_pos = tm.get_head_pos();
-		tape_length = tm.get_tape_length();
-
-		if (tape_length < number_of_cells) {
-			window_start = 0;
-			start = (number_of_cells - tape_length) / 2;
-			end = start + tape_length;
-		} else {
-			window_start = head_pos - number_of_cells / 2;
-			if (window_start < 0) 
-				window_start = 0;
-			if (window_start + number_of_cells >= tape_length)
-				window_start = tape_length - number_of_cells;
-			start = 0;
-			end = number_of_cells;
-		}
+		place_window(tm.get_head_pos(tape), tm.get_tape_begin(tape), tm.get_tape_length(tape));
 		refresh();
 	}
 
+	void show(const machine_snapshot &s)
+	{
+		const machine_snapshot::tape_view &view = s.tapes[tape];
+		place_window(view.head_pos, view.tape_begin, view.tape_length);
+		draw(view.get_range(window_start, window_start + end - start));
+	}
+
 };
 
 class code_window : public ncurses::window {
 
 	const turing_machine &tm;
 	unsigned int start = 0; 
+	size_t size = 0;
+	std::vector<std::string> lines;	// the visible slice of the program
+	std::vector<std::string> shown;	// rows as on screen
+
+	// rewrites only the rows whose text changed, usually the old and new current instruction
+	void draw()
+	{
+		shown.resize(height);
+		for (int row = 0; row < height; row++) {
+			std::string line;
+			if (static_cast<size_t>(row) < lines.size())
+				line = lines[row];
+			if (line != shown[row]) {
+				set_line(row, line.c_str(), line.size());
+				shown[row] = line;
+			}
+		}
+		noutrefresh();
+	}
 
 public:
 	code_window(int height, int width, int starty, int startx, const turing_machine &tm) :
@@ -143,22 +184,14 @@ public:
 
 	void update_code() 
 	{
-		move(0, 0);
-		if (tm.get_program_lines().size() == 0) {
-			erase();
-			refresh();
-			return;
-		}
-		for (size_t i = 0; i < static_cast<size_t>(height) && start + i < tm.get_program_lines().size(); i++) {
-			printw("%s", tm.get_program_lines()[start + i].c_str());
-			clrtoeol(); 
-		}
-		clrtobot();
+		size = tm.get_program_size();
+		lines = tm.get_program_lines(start, height);
+		draw();
 	}
 
 	void scroll_down() 
 	{
-		if (start + height < tm.get_program_lines().size()) {
+		if (start + height < size) {
 			start++;
 			update_code();
 		}
@@ -177,36 +210,101 @@ class machine_status_win : public ncurses::window {
 
 	const turing_machine &tm;
 
+	void print(int row, const std::string &text)
+	{
+		set_line(row, text.c_str(), text.size());
+	}
+
+	void print_status(const std::string &state, const std::string &heads, long steps, const std::string &activity)
+	{
+		print(0, "Current state: " + state);
+		print(1, heads);
+		print(2, "Computation steps: " + std::to_string(steps));
+		print(3, activity);
+		noutrefresh();
+	}
+
 public:
 	machine_status_win(int h, int w, int y, int x, const turing_machine &tm) :
 		window(h, w, y, x, true), tm(tm) {}
 
-	void update_status() 
+	void update_status(const std::string &activity = "") 
+	{
+		std::string heads;
+		for (int t = 0; t < tm.get_tape_count(); t++)
+			heads += (t > 0 ? ", " : "") + std::to_string(tm.get_head_pos(t)) + "/" + std::to_string(tm.get_tape_length(t));
+		print_status(tm.get_current_state(), heads_label(tm.get_tape_count()) + heads, tm.get_computation_steps(),
+			activity);
+	}
+
+	void show(const machine_snapshot &s, const std::string &activity)
 	{
-		move(0, 0);
-		printw("Current state: %s\n", tm.get_current_state().c_str());
-		printw("Head position: %d/%d\n", tm.get_head_pos(), tm.get_tape_length());
-		printw("Computation steps: %d\n", tm.get_computation_steps());
+		std::string heads;
+		for (int t = 0; t < s.tape_count; t++)
+			heads += (t > 0 ? ", " : "") + std::to_string(s.tapes[t].head_pos) + "/" + std::to_string(s.tapes[t].tape_length);
+		print_status(s.state, heads_label(s.tape_count) + heads, s.steps, activity);
+	}
+
+	static std::string heads_label(int tapes)
+	{
+		return tapes > 1 ? "Head positions: " : "Head position: ";
 	}
 };
 
 class gui {
 	turing_machine m;
+	machine_runner runner;
 	ncurses::window root_win;
-	tape_window tape_win;
+	std::vector<std::unique_ptr<tape_window>> tape_wins;
 	ncurses::window cmd_win;
 	code_window code_win;
 	ncurses::window status_win;
 	machine_status_win machine_win;
+	bool paused = false;
+	// steps per second of the running machine, measured over half a second
+	double speed = 0;
+	long last_steps = 0;
+	std::chrono::steady_clock::time_point last_time;
+
+	// stacks a tape window per tape under the title and moves the other
+	// windows below them, only when the number of tapes changed
+	void layout()
+	{
+		size_t count = m.get_tape_count();
+		if (count == tape_wins.size())
+			return;
+
+		int lines = ncurses::get_lines(), cols = ncurses::get_cols();
+		int top = 1 + TAPE_HEIGHT * static_cast<int>(count);
+		int cmd_height = std::max(lines - top - 7, 3);
+
+		// keeps the last lines of output when the command window shrinks
+		int cmd_y = cmd_win.getcury(), cmd_x = cmd_win.getcurx();
+		int excess = cmd_y - (cmd_height - 3);
+		if (excess > 0) {
+			cmd_win.scroll(excess);
+			cmd_win.move(cmd_y - excess, cmd_x);
+		}
+
+		// the margin left of the tapes may show pieces of the old windows
+		tape_wins.clear();
+		root_win.erase();
+		root_win.set_title(TITLE.c_str());
+		machine_win.reshape(6, cols/2, top, 0);
+		cmd_win.reshape(cmd_height, cols/2, top + 6, 0);
+		code_win.reshape(std::max(lines - top - 1, 3), cols/2, top, cols/2);
+		for (size_t t = 0; t < count; t++)
+			tape_wins.emplace_back(new tape_window(TAPE_HEIGHT, cols, 1 + TAPE_HEIGHT * t, 0, m, t));
+	}
 
 public:
 	gui() : 
+		runner(m),
 		root_win(ncurses::initscr()), 
-		tape_win(4, ncurses::get_cols(), 1, 0, m),
-		cmd_win(ncurses::get_lines() - 11, ncurses::get_cols()/2, 10, 0, true),
+		cmd_win(ncurses::get_lines() - 12, ncurses::get_cols()/2, 11, 0, true),
 		code_win(ncurses::get_lines() - 6, ncurses::get_cols()/2, 5, ncurses::get_cols()/2, m),
 		status_win(1, ncurses::get_cols(), ncurses::get_lines() - 1, 0),
-		machine_win(5,  ncurses::get_cols()/2, 5, 0, m)
+		machine_win(6,  ncurses::get_cols()/2, 5, 0, m)
 	{
 		ncurses::set_cbreak(true);
 		root_win.keypad(true);
@@ -218,15 +316,17 @@ public:
 		machine_win.set_title("Machine status");
 
 		root_win.refresh();
-		tape_win.refresh();
+		layout();
 		cmd_win.set_scroll(true);
 		machine_win.update_status();
+		ncurses::doupdate();
 
 		m.reset();
 	}
 
 	~gui() 
 	{
+		runner.stop();
 		ncurses::set_cursor_visible(true);
 		ncurses::set_echo(true);
 		root_win.clear();
@@ -236,9 +336,64 @@ public:
 
 	void update() 
 	{
-		tape_win.update_tape();
+		layout();
+		for (auto &tape_win : tape_wins)
+			tape_win->update_tape();
 		code_win.update_code();
-		machine_win.update_status();
+		machine_win.update_status(paused ? "Paused, p to resume" : "");
+		ncurses::doupdate();
+	}
+
+	// the machine runs on the worker, the screen is drawn from its snapshots
+	// FRAME_RATE times per second till it stops
+	void start_run()
+	{
+		m.check_runnable();
+		stop = false;
+		paused = false;
+		speed = 0;
+		last_steps = m.get_computation_steps();
+		last_time = std::chrono::steady_clock::now();
+		runner.start();
+		root_win.set_timeout(1000 / FRAME_RATE);
+	}
+
+	void end_run(bool pause)
+	{
+		runner.stop();
+		root_win.set_timeout(-1);
+		paused = pause;
+		update();
+	}
+
+	void show_progress()
+	{
+		if (stop) {
+			end_run(true);
+			return;
+		}
+
+		machine_snapshot s;
+		runner.read(s);
+		if (!s.running) {
+			end_run(false);
+			if (!runner.get_error().empty())
+				cmd_win.printw("Error %s\n", runner.get_error().c_str());
+			else if (s.status == run_status::illegal_instruction || s.status == run_status::out_of_memory)
+				cmd_win.printw("Error %s\n", to_string(s.status));
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - last_time).count();
+		if (elapsed >= 0.5) {
+			speed = (s.steps - last_steps) / elapsed;
+			last_steps = s.steps;
+			last_time = now;
+		}
+		for (auto &tape_win : tape_wins)
+			tape_win->show(s);
+		machine_win.show(s, "Running, " + std::to_string(static_cast<long>(speed)) + " steps/s, p to pause");
 	}
 
 	void prompt_command() 
@@ -255,6 +410,7 @@ public:
 		if (status_win.getstr(line) != -1) {
 			try {
 				::parse_line(line, m, out);
+				layout();
 				cmd_win.printw("%s", out.str().c_str());			
 				update(); 
 			} catch (const std::exception &e) {
@@ -270,28 +426,54 @@ public:
 	{
 		while (true) {
 			try {
-				switch(root_win.getch()) {
+				ncurses::chtype key = root_win.getch();
+
+				// while running the other keys pause the machine before touching it
+				if (runner.is_started()) {
+					if (key == ncurses::NO_KEY) {
+						show_progress();
+					} else if (key == 'p') {
+						end_run(true);
+						key = ncurses::NO_KEY;
+					} else if (key == 'r') {
+						key = ncurses::NO_KEY;
+					} else {
+						end_run(true);
+					}
+				}
+
+				switch(key) {
 				case 'q':
 					exit(EXIT_SUCCESS);
 				case ncurses::KEY_LEFT:
-					tape_win.scroll_left();
+					for (auto &tape_win : tape_wins)
+						tape_win->scroll_left();
 					break;
 				case ncurses::KEY_RIGHT:
-					tape_win.scroll_right();
+					for (auto &tape_win : tape_wins)
+						tape_win->scroll_right();
 					break;
 				case 'r':
-					while (m.step() && !stop);
-					update();
+					start_run();
+					break;
+				case 'p':
+					if (paused)
+						start_run();
 					break;
 				case 's':
 					m.step();
 					update();
 					break;
+				case 'b':
+					m.back();
+					update();
+					break;
 				case ':':
 					prompt_command();
 					break;
 				case 'R':
 					m.reset();
+					paused = false;
 					update();
 					break;
 				case '<':
@@ -310,11 +492,13 @@ public:
 					break;
 				case '\\':
 					m.set_tape(m.get_head_pos(), static_cast<char>(root_win.getch()));
-					tape_win.update_tape();
+					tape_wins.front()->update_tape();
 				}
 			} catch(const std::exception &e) {
 				cmd_win.printw("Error %s\n", e.what());
 			}
+			// the windows only stage their changes, the terminal is written once per key
+			ncurses::doupdate();
 		}
 	}
 };
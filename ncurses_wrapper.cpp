@@ -46,6 +46,11 @@ namespace ncurses {
 		return ::acs_map[static_cast<unsigned int>(c)];
 	}
 
+	void doupdate() 
+	{
+		::doupdate();
+	}
+
 	int get_lines() 
 	{
 		return ::LINES;
@@ -87,16 +92,53 @@ namespace ncurses {
 			delwin(outer);
 	}
 
+	void window::draw_title()
+	{
+		int start = width/2 - title.size()/2 - 1;
+		::mvwprintw(box ? outer : win, 0, start, " %s ", title.c_str());
+	}
+
 	void window::set_title(const char *title) 
 	{
-		int start = width/2 - strlen(title)/2 - 1;
+		this->title = title;
+		draw_title();
+		::wrefresh(box ? outer : win);
+	}
+
+	// shrinks before moving down and moves up before growing, so that the
+	// window never crosses the edge of the screen
+	static void place(WINDOW *win, int height, int width, int starty, int startx)
+	{
+		if (starty > ::getbegy(win)) {
+			::wresize(win, height, width);
+			::mvwin(win, starty, startx);
+		} else {
+			::mvwin(win, starty, startx);
+			::wresize(win, height, width);
+		}
+	}
+
+	void window::reshape(int h, int w, int y, int x)
+	{
+		height = h;
+		width = w;
+		start_y = y;
+		start_x = x;
 		if (box) {
-			::mvwprintw(outer, 0, start, " %s ", title);
-			::wrefresh(outer);
-		} else { 
-			::mvwprintw(win, 0, start, " %s ", title);
-			::wrefresh(win);
+			height -= 2;
+			width -= 2;
+			start_x += 1;
+			start_y += 1;
+			place(outer, h, w, y, x);
+			::werase(outer);
+			::box(outer, 0, 0);
+			if (!title.empty())
+				draw_title();
+			::wnoutrefresh(outer);
 		}
+		place(win, height, width, start_y, start_x);
+		::touchwin(win);
+		::wnoutrefresh(win);
 	}
 
 	void window::clear() 
@@ -129,11 +171,21 @@ namespace ncurses {
 		::wrefresh(win);
 	}
 
+	void window::noutrefresh() 
+	{
+		::wnoutrefresh(win);
+	}
+
 	void window::keypad(bool mode) 
 	{
 		::keypad(win, mode);
 	}
 
+	void window::set_timeout(int ms) 
+	{
+		::wtimeout(win, ms);
+	}
+
 	void window::clrtoeol() 
 	{
 		::wclrtoeol(win);
@@ -172,11 +224,33 @@ namespace ncurses {
 		refresh();
 	}
 
+	void window::addchstr(int y, int x, const chtype *str, int n) 
+	{
+		::mvwaddchnstr(win, y, x, str, n);
+	}
+
+	void window::addstr(int y, int x, const char *str, int n) 
+	{
+		::mvwaddnstr(win, y, x, str, n);
+	}
+
+	void window::set_line(int y, const char *str, int n) 
+	{
+		::wmove(win, y, 0);
+		::wclrtoeol(win);
+		::mvwaddnstr(win, y, 0, str, n < width ? n : width);
+	}
+
 	void window::set_scroll(bool val) 
 	{
 		::scrollok(win, val);
 	}
 
+	void window::scroll(int n)
+	{
+		::wscrl(win, n);
+	}
+
 	void window::erase() 
 	{
 		::werase(win);
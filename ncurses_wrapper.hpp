@@ -1,6 +1,8 @@
 #ifndef NCURSES_WRAPPER_H
 #define NCURSES_WRAPPER_H
 
+#include <string>
+
 typedef struct _win_st WINDOW;
 
 namespace ncurses {
@@ -9,6 +11,8 @@ namespace ncurses {
 	enum class charcode : unsigned char;
 
 	typedef unsigned int chtype;
+	// returned by window::getch when the timeout expires
+	const chtype NO_KEY = static_cast<chtype>(-1);
 
 	ncurses::window initscr();
 	void endwin();
@@ -18,11 +22,16 @@ namespace ncurses {
 	int get_lines();
 	int get_cols();
 	chtype get_keycode(charcode c);
+	// sends the changes staged with window::noutrefresh to the terminal
+	void doupdate();
 
 	class window {
 		WINDOW *win;
 		WINDOW *outer;
 		bool box;
+		std::string title;
+
+		void draw_title();
 
 	protected:
 		int height;
@@ -37,20 +46,33 @@ namespace ncurses {
 		~window();
 
 		void set_title(const char *title);
+		// moves and resizes the window, keeping its contents, border and title
+		void reshape(int height, int width, int starty, int startx);
 		void clear();
 		void addch(chtype ch);
 		void addch(charcode code);
 		void move(int y, int x);
 		chtype getch();
 		void refresh();
+		void noutrefresh();
 		void keypad(bool mode);
+		// getch waits at most ms milliseconds, forever if negative
+		void set_timeout(int ms);
 		void clrtoeol();
 		void clrtobot();
 		int getcurx();
 		int getcury();
 		void printw(const char *fmt, ...);
 		void mvprintw(int y, int x, const char *fmt, ...);
+		// write n characters at (y, x) in one call, without moving the cursor
+		// for addchstr
+		void addchstr(int y, int x, const chtype *str, int n);
+		void addstr(int y, int x, const char *str, int n);
+		// replaces row y with the first n characters of str, cut at the window width
+		void set_line(int y, const char *str, int n);
 		void set_scroll(bool val);
+		// scrolls the contents up by n lines
+		void scroll(int n);
 		void erase();
 		int getstr(char *str);
 		void attron(int attr);
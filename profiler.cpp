@@ -0,0 +1,125 @@
+#include "profiler.hpp"
+#include "undo_log.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+long profiler::record(const transition_table &table, char *tape, long &head, uint32_t &state, long n,
+	run_status &status, undo_log *log)
+{
+	// a table mapped from a binary program is never rebuilt, only swapped
+	if (table.get_cells() != profiled || hits.size() != table.get_size()) {
+		clear();
+		hits.assign(table.get_size(), 0);
+		profiled = table.get_cells();
+	}
+
+	const int shift = table.get_row_shift();
+	const uint8_t *column = table.get_columns();
+	uint64_t *count = hits.data();
+	long h = head;
+	uint32_t s = state;
+	int last = last_delta;
+	uint64_t turns = 0;
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		char c = tape[h];
+		count[(s << shift) | column[static_cast<unsigned char>(c)]]++;
+		transition_table::cell next = table.get_cell(s, c);
+		int delta = transition_table::head_delta(next);
+		turns += delta * last < 0;
+		last = delta;
+		done++;
+		if (log != nullptr)
+			log->push(c, delta, s);
+
+		tape[h] = transition_table::write_symbol(next);
+		h += delta;
+		s = transition_table::next_state(next);
+		if (transition_table::is_stop(next)) {
+			status = transition_table::is_defined(next) ? run_status::halted : run_status::illegal_instruction;
+			break;
+		}
+	}
+
+	steps += done;
+	reversals += turns;
+	last_delta = last;
+	head = h;
+	state = s;
+	return done;
+}
+
+void profiler::clear()
+{
+	std::fill(hits.begin(), hits.end(), 0);
+	steps = 0;
+	reversals = 0;
+	last_delta = 0;
+}
+
+std::vector<profiler::entry> profiler::get_entries(const transition_table &table,
+	const std::vector<instruction> &program) const
+{
+	std::vector<entry> result;
+	if (table.get_cells() != profiled)
+		return result;
+
+	// the symbol read by each column
+	const int shift = table.get_row_shift();
+	const uint8_t *column = table.get_columns();
+	char symbol[transition_table::SYMBOLS] = {};
+	for (int c = 0; c < transition_table::SYMBOLS; c++)
+		if (!table.is_compact() || column[c] != 0)
+			symbol[column[c]] = static_cast<char>(c);
+
+	std::unordered_map<uint64_t, size_t> cell_entry;
+	std::unordered_map<uint32_t, size_t> wildcard_line;
+	size_t mask = (size_t(1) << shift) - 1;
+	for (size_t i = 0; i < hits.size(); i++) {
+		if (hits[i] == 0)
+			continue;
+		bool other = table.is_compact() && (i & mask) == 0;
+		entry e = { 0, static_cast<uint32_t>(i >> shift), symbol[i & mask], other, hits[i] };
+		// the symbols are below 128, the other column gets the key no instruction reads
+		if (!other)
+			cell_entry[uint64_t(e.state) << 8 | static_cast<unsigned char>(e.symbol)] = result.size();
+		wildcard_line[e.state] = 0;
+		result.push_back(e);
+	}
+
+	// the last instruction added for a (state, symbol) pair wins, as in the table
+	for (size_t l = 0; l < program.size(); l++) {
+		const instruction &i = program[l];
+		uint32_t s = static_cast<uint32_t>(i.from_state);
+		if (i.symbol_read == '-') {
+			auto w = wildcard_line.find(s);
+			if (w != wildcard_line.end())
+				w->second = l + 1;
+		} else {
+			auto c = cell_entry.find(uint64_t(s) << 8 | static_cast<unsigned char>(i.symbol_read));
+			if (c != cell_entry.end())
+				result[c->second].line = l + 1;
+		}
+	}
+	for (entry &e : result)
+		if (e.line == 0)
+			e.line = wildcard_line[e.state];
+
+	std::stable_sort(result.begin(), result.end(), [](const entry &a, const entry &b) {
+		return a.hits > b.hits;
+	});
+	return result;
+}
+
+uint64_t profiler::get_steps() const
+{
+	return steps;
+}
+
+uint64_t profiler::get_reversals() const
+{
+	return reversals;
+}
@@ -0,0 +1,63 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "transition_table.hpp"
+
+class undo_log;
+
+/*
+ * Execution profile of a machine: one counter per cell of the transition
+ * table, so a step costs a single increment, plus a count of the head
+ * reversals. The hits per instruction, state and symbol are summed up from
+ * the cells when asked for.
+ *
+ * The counters belong to one build of the table, they start over when the
+ * program changes and the table is rebuilt.
+ */
+class profiler {
+	std::vector<uint64_t> hits;
+	const transition_table::cell *profiled = nullptr;	// cells of the table counted
+	uint64_t steps = 0;
+	uint64_t reversals = 0;
+	int last_delta = 0;
+
+public:
+	// one hit cell, with the program line that handles it
+	struct entry {
+		size_t line;	// 1 based, 0 for undefined transitions
+		uint32_t state;
+		char symbol;
+		bool other;	// column 0 of a compact table: the symbols no instruction reads
+		uint64_t hits;
+	};
+
+	// same contract as transition_table::execute, counting every step and
+	// recording it to log when given
+	long record(const transition_table& table, char *tape, long &head, uint32_t &state, long n, run_status &status,
+		undo_log *log = nullptr);
+
+	void clear();
+
+	// the cells hit at least once, hottest first
+	std::vector<entry> get_entries(const transition_table& table, const std::vector<instruction>& program) const;
+	uint64_t get_steps() const;
+	uint64_t get_reversals() const;
+};
+
+// adapter to run a table through run_segments while profiling the steps,
+// and recording them when an undo log is given
+struct profiling_engine {
+	const transition_table& table;
+	profiler& prof;
+	undo_log *log;
+
+	long execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+	{
+		return prof.record(table, tape, head, state, n, status, log);
+	}
+};
+
+#endif
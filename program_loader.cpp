@@ -0,0 +1,107 @@
+#include "program_loader.hpp"
+#include "tokenizer.hpp"
+
+#include <cstring>
+#include <string>
+
+static const size_t MIN_SLOTS = 1024;
+
+static uint64_t hash_name(const char *name, size_t size)
+{
+	// FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++) {
+		h ^= static_cast<unsigned char>(name[i]);
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+program_loader::program_loader(turing_machine &tm)
+	: tm(tm), slots(MIN_SLOTS, slot{0, 0, 0})
+{
+}
+
+void program_loader::grow()
+{
+	std::vector<slot> old(slots.size() * 2, slot{0, 0, 0});
+	old.swap(slots);
+	size_t mask = slots.size() - 1;
+	for (const slot &s : old) {
+		if (s.generation != generation)
+			continue;
+		size_t i = s.hash & mask;
+		while (slots[i].generation == generation)
+			i = (i + 1) & mask;
+		slots[i] = s;
+	}
+}
+
+int program_loader::intern(const char *name, size_t size)
+{
+	if ((used + 1) * 2 > slots.size())
+		grow();
+
+	uint64_t h = hash_name(name, size);
+	size_t mask = slots.size() - 1;
+	for (size_t i = h & mask; ; i = (i + 1) & mask) {
+		slot &s = slots[i];
+		if (s.generation != generation) {
+			int code = tm.get_state_code(std::string(name, size));
+			s = { h, generation, code };
+			used++;
+			return code;
+		}
+		if (s.hash == h) {
+			const std::string &known = tm.state_name[s.code];
+			if (known.size() == size && std::memcmp(known.data(), name, size) == 0)
+				return s.code;
+		}
+	}
+}
+
+bool program_loader::parse(const char *begin, const char *end)
+{
+	// empty lines and comments, without the cost of the tokenizer exception
+	const char *p = begin;
+	while (p < end && *p == ' ')
+		p++;
+	if (p == end || *p == '\n' || *p == '\t' || *p == ';')
+		return true;
+
+	tokenizer t(p, end);
+	token command = t.next_token();
+	if (!(command == "+" || command == "add"))
+		return false;
+	// the tuples of multi-tape machines go through parse_line
+	if (tm.tape_count > 1)
+		return false;
+
+	token from = t.next_token();
+	char read = t.next_symbol();
+	token to = t.next_token();
+	char write = t.next_symbol();
+	direction dir = t.next_direction();
+
+	int from_code = intern(from.data, from.size);
+	int to_code = intern(to.data, to.size);
+	tm.program.push_back({ from_code, read, to_code, write, dir });
+	added = true;
+	return true;
+}
+
+void program_loader::flush()
+{
+	if (added) {
+		tm.program_lines.clear();
+		tm.table_dirty = true;
+		tm.forget_history();
+		added = false;
+	}
+
+	used = 0;
+	if (++generation == 0) {
+		slots.assign(slots.size(), slot{0, 0, 0});
+		generation = 1;
+	}
+}
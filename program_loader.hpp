@@ -0,0 +1,47 @@
+#ifndef PROGRAM_LOADER_H
+#define PROGRAM_LOADER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "turing_machine.hpp"
+
+/*
+ * Fast path for the instruction lines of large program files. Lines are
+ * tokenized in place, state names are interned through an open addressing
+ * table of views, so a string is only allocated the first time a state is
+ * seen, and instructions are appended straight to the program. The
+ * transition table is rebuilt once, when the machine next runs.
+ *
+ * State codes are assigned in the same order as add_instruction does.
+ */
+class program_loader {
+	struct slot {
+		uint64_t hash;
+		uint32_t generation;	// slots of older generations are empty
+		int code;
+	};
+
+	turing_machine& tm;
+	std::vector<slot> slots;
+	size_t used = 0;
+	uint32_t generation = 1;
+	bool added = false;
+
+	int intern(const char *name, size_t size);
+	void grow();
+
+public:
+	program_loader(turing_machine& tm);
+
+	// adds the instruction on the line, true if the line was an instruction,
+	// empty or a comment, false for the lines to be run as commands
+	bool parse(const char *begin, const char *end);
+
+	// to be called before running commands on the machine: makes the
+	// instructions parsed so far part of the program and forgets the state
+	// codes, the commands could replace the states
+	void flush();
+};
+
+#endif
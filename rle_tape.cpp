@@ -0,0 +1,205 @@
+#include "rle_tape.hpp"
+
+#include <algorithm>
+
+const long rle_tape::BLANK_CHUNK = 1L << 20;
+
+rle_tape::rle_tape(const tape_storage &tape, long head, bool bounded)
+	: head(head), lo(tape.get_begin()), blank(tape.get_blank()), bounded(bounded)
+{
+	long hi = tape.get_end();
+	if (!bounded) {
+		lo = std::min(lo, head);
+		hi = std::max(hi, head + 1);
+	}
+
+	// encode the whole tape left to right, then move what follows the head
+	// on the right stack
+	std::vector<run> runs;
+	long pos = lo;
+	while (pos < hi) {
+		const char *cells = nullptr;
+		long n = 0;
+		if (pos >= tape.get_begin() && pos < tape.get_end())
+			n = std::min(tape.view(pos, cells), hi - pos);
+		else
+			n = (pos < tape.get_begin() ? tape.get_begin() : hi) - pos;
+
+		if (cells == nullptr) {
+			push(runs, blank, n);
+		} else {
+			for (long i = 0; i < n; ) {
+				long j = i + 1;
+				while (j < n && cells[j] == cells[i])
+					j++;
+				push(runs, cells[i], j - i);
+				i = j;
+			}
+		}
+		pos += n;
+	}
+
+	if (head < lo || head >= hi) {
+		outside = true;
+		if (head < lo)
+			right.assign(runs.rbegin(), runs.rend());
+		else
+			left = runs;
+		return;
+	}
+
+	pos = lo;
+	for (const run &r : runs) {
+		if (pos + r.count <= head) {
+			left.push_back(r);
+		} else if (pos >= head) {
+			right.push_back(r);
+		} else {
+			left.push_back({ r.symbol, head - pos });
+			right.push_back({ r.symbol, pos + r.count - head });
+		}
+		pos += r.count;
+	}
+	std::reverse(right.begin(), right.end());
+}
+
+void rle_tape::push(std::vector<run> &stack, char symbol, long count)
+{
+	if (!stack.empty() && stack.back().symbol == symbol)
+		stack.back().count += count;
+	else
+		stack.push_back({ symbol, count });
+}
+
+char rle_tape::pop(std::vector<run> &stack, long count)
+{
+	char symbol = stack.back().symbol;
+	stack.back().count -= count;
+	if (stack.back().count == 0)
+		stack.pop_back();
+	return symbol;
+}
+
+char rle_tape::read() const
+{
+	return right.back().symbol;
+}
+
+long rle_tape::get_head() const
+{
+	return head;
+}
+
+bool rle_tape::is_outside() const
+{
+	return outside;
+}
+
+// moves the cell left of the head to the top of the right stack
+void rle_tape::take_left()
+{
+	if (left.empty()) {
+		if (bounded) {
+			outside = true;
+			return;
+		}
+		left.push_back({ blank, BLANK_CHUNK });
+		lo -= BLANK_CHUNK;
+	}
+	push(right, pop(left, 1), 1);
+}
+
+// makes sure the head cell is on the right stack after moving right
+void rle_tape::check_right()
+{
+	if (right.empty()) {
+		if (bounded)
+			outside = true;
+		else
+			right.push_back({ blank, BLANK_CHUNK });
+	}
+}
+
+void rle_tape::mark(long begin, long end)
+{
+	dirty_lo = std::min(dirty_lo, begin);
+	dirty_hi = std::max(dirty_hi, end);
+}
+
+void rle_tape::step(char write, int delta)
+{
+	mark(head, head + 1);
+	pop(right, 1);
+	if (delta > 0) {
+		push(left, write, 1);
+		head++;
+		check_right();
+	} else {
+		push(right, write, 1);
+		head--;
+		take_left();
+	}
+}
+
+long rle_tape::sweep(char write, int delta, long max)
+{
+	long steps;
+
+	if (delta > 0) {
+		// the run on top of the right stack starts at the head
+		steps = std::min(right.back().count, max);
+		mark(head, head + steps);
+		pop(right, steps);
+		push(left, write, steps);
+		head += steps;
+		check_right();
+	} else {
+		// the head cell plus the run ending just left of it, if it has the same symbol
+		char symbol = pop(right, 1);
+		long more = 0;
+		if (!left.empty() && left.back().symbol == symbol) {
+			more = std::min(left.back().count, max - 1);
+			pop(left, more);
+		}
+		steps = more + 1;
+		mark(head - more, head + 1);
+		push(right, write, steps);
+		head -= steps;
+		take_left();
+	}
+
+	return steps;
+}
+
+void rle_tape::write_back(tape_storage &tape)
+{
+	auto emit = [&](char symbol, long begin, long end) {
+		begin = std::max(begin, dirty_lo);
+		end = std::min(end, dirty_hi);
+		// blank cells outside of the stored tape are already implicit
+		if (symbol == blank) {
+			begin = std::max(begin, tape.get_begin());
+			end = std::min(end, tape.get_end());
+		}
+		if (begin < end)
+			tape.fill(begin, end, symbol);
+	};
+
+	// only the runs over the changed cells are visited, walking out from the
+	// head. Past the left edge of a bounded tape the right stack starts at
+	// the cell after the head, otherwise at the head
+	long split = outside && head < lo ? head + 1 : head;
+	long pos = split;
+	for (auto r = left.rbegin(); r != left.rend() && pos > dirty_lo; ++r) {
+		emit(r->symbol, pos - r->count, pos);
+		pos -= r->count;
+	}
+	pos = split;
+	for (auto r = right.rbegin(); r != right.rend() && pos < dirty_hi; ++r) {
+		emit(r->symbol, pos, pos + r->count);
+		pos += r->count;
+	}
+
+	dirty_lo = LONG_MAX;
+	dirty_hi = LONG_MIN;
+}
@@ -0,0 +1,59 @@
+#ifndef RLE_TAPE_H
+#define RLE_TAPE_H
+
+#include <climits>
+#include <vector>
+
+#include "tape_storage.hpp"
+
+/*
+ * Run-length encoded tape, stored as two stacks of runs around the head.
+ * The top of the right stack is the run starting at the head cell, the top
+ * of the left stack is the run ending just before it. Runs covered by a
+ * self-looping transition can be crossed in a single operation.
+ */
+class rle_tape {
+public:
+	struct run {
+		char symbol;
+		long count;
+	};
+
+	rle_tape(const tape_storage& tape, long head, bool bounded);
+
+	char read() const;
+	long get_head() const;
+	bool is_outside() const;
+
+	// executes one step writing `write` and moving the head by `delta`
+	void step(char write, int delta);
+
+	// executes at most max steps of a transition looping on the symbol under
+	// the head, stops at the end of the run and returns the steps executed
+	long sweep(char write, int delta, long max);
+
+	// writes the cells changed since the last call back to the tape, so the
+	// encoding can be kept for the next run as long as nothing else changes it
+	void write_back(tape_storage& tape);
+
+private:
+	static const long BLANK_CHUNK;
+
+	std::vector<run> left;
+	std::vector<run> right;
+	long head;
+	long lo; // position of the leftmost encoded cell
+	char blank;
+	bool bounded;
+	bool outside = false;
+	long dirty_lo = LONG_MAX; // cells written since the last write back
+	long dirty_hi = LONG_MIN;
+
+	static void push(std::vector<run>& stack, char symbol, long count);
+	static char pop(std::vector<run>& stack, long count);
+	void take_left();
+	void check_right();
+	void mark(long begin, long end);
+};
+
+#endif
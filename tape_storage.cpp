@@ -0,0 +1,534 @@
+#include "tape_storage.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+const long unbounded_tape::GROWTH_SLACK = 4096;
+const long sparse_tape::PAGE_SIZE = 1 << 16;
+// a window moving with the head keeps the margin behind it, so sweeps
+// repack about once every WINDOW_SIZE cells
+const long packed_tape::WINDOW_SIZE = 1 << 16;
+const long packed_tape::WINDOW_MARGIN = 1 << 12;
+
+const char *to_string(tape_mode mode)
+{
+	switch (mode) {
+		case tape_mode::fixed: return "fixed";
+		case tape_mode::unbounded: return "unbounded";
+		case tape_mode::sparse: return "sparse";
+		case tape_mode::packed: return "packed";
+	}
+	return "unknown";
+}
+
+tape_storage *tape_storage::create(tape_mode mode, long size, char blank)
+{
+	switch (mode) {
+		case tape_mode::fixed: return new fixed_tape(size, blank);
+		case tape_mode::unbounded: return new unbounded_tape(size, blank);
+		case tape_mode::sparse: return new sparse_tape(size, blank);
+		case tape_mode::packed: return new packed_tape(size, blank);
+	}
+	throw std::invalid_argument("Invalid tape mode");
+}
+
+std::string tape_storage::read(long begin, long end) const
+{
+	std::string result;
+	for (long pos = begin; pos < end; pos++)
+		result += get(pos);
+	return result;
+}
+
+void tape_storage::fill(long begin, long end, char c)
+{
+	for (long pos = begin; pos < end; pos++)
+		set(pos, c);
+}
+
+void tape_storage::data_extent(long &low, long &high) const
+{
+	for (long pos = get_begin(); pos < get_end(); ) {
+		const char *cells;
+		long count = view(pos, cells);
+		for (long i = 0; cells != nullptr && i < count; i++) {
+			if (cells[i] != blank) {
+				low = std::min(low, pos + i);
+				high = std::max(high, pos + i);
+			}
+		}
+		pos += count;
+	}
+}
+
+// fixed tape
+fixed_tape::fixed_tape(long size, char blank)
+	: tape_storage(blank), cells(size, blank)
+{
+}
+
+long fixed_tape::get_begin() const
+{
+	return 0;
+}
+
+long fixed_tape::get_end() const
+{
+	return cells.size();
+}
+
+bool fixed_tape::in_bounds(long pos) const
+{
+	return pos >= 0 && pos < get_end();
+}
+
+bool fixed_tape::acquire(long pos, tape_segment &seg)
+{
+	if (!in_bounds(pos))
+		return false;
+	seg = { &cells[0], 0, get_end() };
+	return true;
+}
+
+char fixed_tape::get(long pos) const
+{
+	return in_bounds(pos) ? cells[pos] : blank;
+}
+
+void fixed_tape::set(long pos, char c)
+{
+	if (!in_bounds(pos))
+		throw std::runtime_error("Position out of tape");
+	cells[pos] = c;
+}
+
+void fixed_tape::clear(char b)
+{
+	blank = b;
+	std::fill(cells.begin(), cells.end(), blank);
+}
+
+std::string fixed_tape::read(long begin, long end) const
+{
+	if (begin >= 0 && end <= get_end())
+		return cells.substr(begin, end - begin);
+	return tape_storage::read(begin, end);
+}
+
+void fixed_tape::fill(long begin, long end, char c)
+{
+	if (begin < 0 || end > get_end())
+		throw std::runtime_error("Position out of tape");
+	std::fill(cells.begin() + begin, cells.begin() + end, c);
+}
+
+long fixed_tape::view(long pos, const char *&c) const
+{
+	c = cells.data() + pos;
+	return get_end() - pos;
+}
+
+// unbounded tape
+unbounded_tape::unbounded_tape(long size, char blank)
+	: tape_storage(blank), cells(std::max(size, 1L), blank), origin(0)
+{
+}
+
+long unbounded_tape::get_begin() const
+{
+	return origin;
+}
+
+long unbounded_tape::get_end() const
+{
+	return origin + cells.size();
+}
+
+bool unbounded_tape::in_bounds(long /* unused */) const
+{
+	return true;
+}
+
+bool unbounded_tape::acquire(long pos, tape_segment &seg)
+{
+	long size = cells.size();
+
+	// grow at least by the current size to keep reallocations amortized
+	if (pos < origin) {
+		long grow = std::max(size, origin - pos + GROWTH_SLACK);
+		cells.insert(0, grow, blank);
+		origin -= grow;
+	} else if (pos >= origin + size) {
+		long grow = std::max(size, pos - origin - size + 1 + GROWTH_SLACK);
+		cells.append(grow, blank);
+	}
+
+	seg = { &cells[0], get_begin(), get_end() };
+	return true;
+}
+
+char unbounded_tape::get(long pos) const
+{
+	if (pos < get_begin() || pos >= get_end())
+		return blank;
+	return cells[pos - origin];
+}
+
+void unbounded_tape::set(long pos, char c)
+{
+	tape_segment seg;
+	acquire(pos, seg);
+	cells[pos - origin] = c;
+}
+
+void unbounded_tape::clear(char b)
+{
+	blank = b;
+	std::fill(cells.begin(), cells.end(), blank);
+}
+
+std::string unbounded_tape::read(long begin, long end) const
+{
+	if (begin >= get_begin() && end <= get_end())
+		return cells.substr(begin - origin, end - begin);
+	return tape_storage::read(begin, end);
+}
+
+void unbounded_tape::fill(long begin, long end, char c)
+{
+	tape_segment seg;
+	acquire(begin, seg);
+	acquire(end - 1, seg);
+	std::fill(cells.begin() + (begin - origin), cells.begin() + (end - origin), c);
+}
+
+long unbounded_tape::view(long pos, const char *&c) const
+{
+	c = cells.data() + (pos - origin);
+	return get_end() - pos;
+}
+
+// sparse tape
+sparse_tape::sparse_tape(long size, char blank)
+	: tape_storage(blank), size(size)
+{
+}
+
+char *sparse_tape::get_page(long index)
+{
+	std::unique_ptr<char[]> &page = pages[index];
+	if (!page) {
+		page.reset(new char[PAGE_SIZE]);
+		std::fill(page.get(), page.get() + PAGE_SIZE, blank);
+	}
+	return page.get();
+}
+
+long sparse_tape::get_begin() const
+{
+	return 0;
+}
+
+long sparse_tape::get_end() const
+{
+	return size;
+}
+
+bool sparse_tape::in_bounds(long pos) const
+{
+	return pos >= 0 && pos < size;
+}
+
+bool sparse_tape::acquire(long pos, tape_segment &seg)
+{
+	if (!in_bounds(pos))
+		return false;
+	long index = pos / PAGE_SIZE;
+	long begin = index * PAGE_SIZE;
+	seg = { get_page(index), begin, std::min(begin + PAGE_SIZE, size) };
+	return true;
+}
+
+char sparse_tape::get(long pos) const
+{
+	if (!in_bounds(pos))
+		return blank;
+	auto page = pages.find(pos / PAGE_SIZE);
+	if (page == pages.end())
+		return blank;
+	return page->second[pos % PAGE_SIZE];
+}
+
+void sparse_tape::set(long pos, char c)
+{
+	if (!in_bounds(pos))
+		throw std::runtime_error("Position out of tape");
+	get_page(pos / PAGE_SIZE)[pos % PAGE_SIZE] = c;
+}
+
+void sparse_tape::clear(char b)
+{
+	blank = b;
+	pages.clear();
+}
+
+size_t sparse_tape::get_allocated_pages() const
+{
+	return pages.size();
+}
+
+void sparse_tape::fill(long begin, long end, char c)
+{
+	if (begin < 0 || end > size)
+		throw std::runtime_error("Position out of tape");
+	while (begin < end) {
+		long index = begin / PAGE_SIZE;
+		long page_end = std::min((index + 1) * PAGE_SIZE, end);
+		// filling a missing page with blanks doesn't need to allocate it
+		if (c != blank || pages.count(index)) {
+			char *page = get_page(index);
+			std::fill(page + begin % PAGE_SIZE, page + (page_end - index * PAGE_SIZE), c);
+		}
+		begin = page_end;
+	}
+}
+
+long sparse_tape::view(long pos, const char *&c) const
+{
+	long index = pos / PAGE_SIZE;
+	auto page = pages.find(index);
+	c = page == pages.end() ? nullptr : page->second.get() + pos % PAGE_SIZE;
+	return std::min((index + 1) * PAGE_SIZE, size) - pos;
+}
+
+// packed tape
+packed_tape::packed_tape(long size, char blank)
+	: tape_storage(blank), size(size)
+{
+	clear(blank);
+}
+
+long packed_tape::get_begin() const
+{
+	return 0;
+}
+
+long packed_tape::get_end() const
+{
+	return size;
+}
+
+bool packed_tape::in_bounds(long pos) const
+{
+	return pos >= 0 && pos < size;
+}
+
+int packed_tape::get_cell_bits() const
+{
+	return 1 << bits_shift;
+}
+
+int packed_tape::load(long pos) const
+{
+	int offset = (pos & ((1L << cell_shift()) - 1)) << bits_shift;
+	return (words[pos >> cell_shift()] >> offset) & ((1 << (1 << bits_shift)) - 1);
+}
+
+void packed_tape::store(long pos, int code)
+{
+	int offset = (pos & ((1L << cell_shift()) - 1)) << bits_shift;
+	uint64_t mask = ((uint64_t(1) << (1 << bits_shift)) - 1) << offset;
+	uint64_t &w = words[pos >> cell_shift()];
+	w = (w & ~mask) | (static_cast<uint64_t>(code) << offset);
+}
+
+void packed_tape::widen(int shift)
+{
+	int wide_cell_shift = 6 - shift;
+	std::vector<uint64_t> wide((size >> wide_cell_shift) + 1, 0);
+	for (long pos = 0; pos < size; pos++) {
+		int offset = (pos & ((1L << wide_cell_shift) - 1)) << shift;
+		wide[pos >> wide_cell_shift] |= static_cast<uint64_t>(load(pos)) << offset;
+	}
+	words.swap(wide);
+	bits_shift = shift;
+}
+
+int packed_tape::code_of(char c)
+{
+	unsigned char u = static_cast<unsigned char>(c);
+	if (u >= transition_table::SYMBOLS)
+		throw std::runtime_error(std::string("Invalid tape symbol: ") + c);
+	if (codes[u] >= 0)
+		return codes[u];
+
+	int code = symbols.size();
+	if (code >> (1 << bits_shift) != 0)
+		widen(bits_shift + 1);
+	codes[u] = code;
+	symbols += c;
+	return code;
+}
+
+bool packed_tape::unpack(long begin, long end, char *out) const
+{
+	bool blank_only = true;
+	int bits = 1 << bits_shift;
+	int mask = (1 << bits) - 1;
+	for (long pos = begin; pos < end; ) {
+		long index = pos >> cell_shift();
+		long stop = std::min(end, (index + 1) << cell_shift());
+		uint64_t w = words[index];
+		if (w == 0) {
+			std::fill(out + (pos - begin), out + (stop - begin), symbols[0]);
+			pos = stop;
+			continue;
+		}
+		blank_only = false;
+		for (; pos < stop; pos++)
+			out[pos - begin] = symbols[(w >> ((pos & ((1L << cell_shift()) - 1)) << bits_shift)) & mask];
+	}
+	return blank_only;
+}
+
+void packed_tape::pack(long begin, long end, const char *in)
+{
+	// code every symbol first, the cells could grow
+	bool seen[transition_table::SYMBOLS] = {};
+	for (long pos = begin; pos < end; pos++) {
+		unsigned char u = static_cast<unsigned char>(in[pos - begin]);
+		if (!seen[u]) {
+			seen[u] = true;
+			code_of(in[pos - begin]);
+		}
+	}
+
+	long per_word = 1L << cell_shift();
+	for (long pos = begin; pos < end; ) {
+		long index = pos >> cell_shift();
+		long stop = std::min(end, (index + 1) << cell_shift());
+		if (pos - (index << cell_shift()) != 0 || stop - pos != per_word) {
+			for (; pos < stop; pos++)
+				store(pos, codes[static_cast<unsigned char>(in[pos - begin])]);
+			continue;
+		}
+		uint64_t w = 0;
+		for (long i = 0; i < per_word; i++)
+			w |= static_cast<uint64_t>(codes[static_cast<unsigned char>(in[pos - begin + i])]) << (i << bits_shift);
+		words[index] = w;
+		pos = stop;
+	}
+}
+
+void packed_tape::flush_window()
+{
+	if (window_begin < window_end)
+		pack(window_begin, window_end, window.data());
+}
+
+bool packed_tape::acquire(long pos, tape_segment &seg)
+{
+	if (!in_bounds(pos))
+		return false;
+
+	if (pos < window_begin || pos >= window_end) {
+		flush_window();
+		long length = std::min(size, WINDOW_SIZE);
+		long begin;
+		if (window_begin < window_end && pos == window_end)
+			begin = pos - WINDOW_MARGIN;
+		else if (window_begin < window_end && pos == window_begin - 1)
+			begin = pos + 1 + WINDOW_MARGIN - length;
+		else
+			begin = pos - length / 2;
+		window_begin = std::max(0L, std::min(begin, size - length));
+		window_end = window_begin + length;
+		window.resize(length);
+		unpack(window_begin, window_end, &window[0]);
+	}
+
+	seg = { &window[0], window_begin, window_end };
+	return true;
+}
+
+char packed_tape::get(long pos) const
+{
+	if (!in_bounds(pos))
+		return blank;
+	if (pos >= window_begin && pos < window_end)
+		return window[pos - window_begin];
+	return symbols[load(pos)];
+}
+
+void packed_tape::set(long pos, char c)
+{
+	if (!in_bounds(pos))
+		throw std::runtime_error("Position out of tape");
+	if (pos >= window_begin && pos < window_end)
+		window[pos - window_begin] = c;
+	else
+		store(pos, code_of(c));
+}
+
+void packed_tape::clear(char b)
+{
+	blank = b;
+	// the blank is code 0, so a cleared tape is all zeros
+	std::string reserved = symbols;
+	symbols.assign(1, blank);
+	std::fill(codes, codes + transition_table::SYMBOLS, -1);
+	codes[static_cast<unsigned char>(blank)] = 0;
+	bits_shift = 0;
+	words.assign((size >> cell_shift()) + 1, 0);
+	window_begin = window_end = 0;
+	reserve(reserved);
+}
+
+std::string packed_tape::read(long begin, long end) const
+{
+	if (begin < 0 || end > size || begin >= end)
+		return tape_storage::read(begin, end);
+
+	std::string result(end - begin, blank);
+	unpack(begin, end, &result[0]);
+	long low = std::max(begin, window_begin), high = std::min(end, window_end);
+	if (low < high)
+		std::copy(window.begin() + (low - window_begin), window.begin() + (high - window_begin),
+			result.begin() + (low - begin));
+	return result;
+}
+
+long packed_tape::view(long pos, const char *&c) const
+{
+	if (pos >= window_begin && pos < window_end) {
+		c = window.data() + (pos - window_begin);
+		return window_end - pos;
+	}
+
+	long end = std::min(pos + WINDOW_SIZE, pos < window_begin ? window_begin : size);
+	scratch.resize(end - pos);
+	c = unpack(pos, end, &scratch[0]) ? nullptr : scratch.data();
+	return end - pos;
+}
+
+void packed_tape::reserve(const std::string &s)
+{
+	// the cells needed by all the symbols at once, rather than growing one
+	// bit at a time
+	bool counted[transition_table::SYMBOLS] = {};
+	int count = symbols.size();
+	for (char c : s) {
+		unsigned char u = static_cast<unsigned char>(c);
+		if (codes[u] < 0 && !counted[u]) {
+			counted[u] = true;
+			count++;
+		}
+	}
+	int shift = bits_shift;
+	while (count > (1 << (1 << shift)))
+		shift++;
+	if (shift != bits_shift)
+		widen(shift);
+	for (char c : s)
+		code_of(c);
+}
@@ -0,0 +1,220 @@
+#ifndef TAPE_STORAGE_H
+#define TAPE_STORAGE_H
+
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "transition_table.hpp"
+
+enum class tape_mode {fixed, unbounded, sparse, packed};
+
+const char *to_string(tape_mode mode);
+
+// a contiguous slice of the tape the interpreter can run on without checks
+struct tape_segment {
+	char *cells; // cells[0] is the cell at position begin
+	long begin;
+	long end;
+};
+
+class tape_storage {
+protected:
+	char blank;
+
+public:
+	tape_storage(char blank) : blank(blank) {}
+	virtual ~tape_storage() = default;
+
+	// positions in [get_begin(), get_end()) are currently stored
+	virtual long get_begin() const = 0;
+	virtual long get_end() const = 0;
+	virtual bool in_bounds(long pos) const = 0;
+
+	// makes pos addressable and returns the segment holding it,
+	// false if pos is outside of the tape
+	virtual bool acquire(long pos, tape_segment& seg) = 0;
+
+	virtual char get(long pos) const = 0;
+	virtual void set(long pos, char c) = 0;
+	virtual void clear(char blank) = 0;
+	virtual std::string read(long begin, long end) const;
+	virtual void fill(long begin, long end, char c);
+
+	// read-only access to the stored cells starting at pos, returns how many
+	// consecutive cells are described, cells is null if they're all blank
+	virtual long view(long pos, const char *& cells) const = 0;
+
+	// symbols about to be stored, lets tapes encoding the symbols choose
+	// their cell size once
+	virtual void reserve(const std::string& /* symbols */) {}
+
+	// extends [low, high] to cover every non blank cell
+	void data_extent(long& low, long& high) const;
+
+	long get_length() const { return get_end() - get_begin(); }
+	char get_blank() const { return blank; }
+
+	static tape_storage *create(tape_mode mode, long size, char blank);
+};
+
+// fixed size tape, moving out of it is an error
+class fixed_tape : public tape_storage {
+	std::string cells;
+
+public:
+	fixed_tape(long size, char blank);
+
+	long get_begin() const override;
+	long get_end() const override;
+	bool in_bounds(long pos) const override;
+	bool acquire(long pos, tape_segment& seg) override;
+	char get(long pos) const override;
+	void set(long pos, char c) override;
+	void clear(char blank) override;
+	std::string read(long begin, long end) const override;
+	void fill(long begin, long end, char c) override;
+	long view(long pos, const char *& cells) const override;
+};
+
+// two-way infinite tape, grows geometrically in the direction it's needed
+class unbounded_tape : public tape_storage {
+	static const long GROWTH_SLACK;
+
+	std::string cells;
+	long origin;
+
+public:
+	unbounded_tape(long size, char blank);
+
+	long get_begin() const override;
+	long get_end() const override;
+	bool in_bounds(long pos) const override;
+	bool acquire(long pos, tape_segment& seg) override;
+	char get(long pos) const override;
+	void set(long pos, char c) override;
+	void clear(char blank) override;
+	std::string read(long begin, long end) const override;
+	void fill(long begin, long end, char c) override;
+	long view(long pos, const char *& cells) const override;
+};
+
+// fixed size tape made of pages allocated the first time they're touched,
+// blank pages are implicit
+class sparse_tape : public tape_storage {
+	static const long PAGE_SIZE;
+
+	std::unordered_map<long, std::unique_ptr<char[]> > pages;
+	long size;
+
+	char *get_page(long index);
+
+public:
+	sparse_tape(long size, char blank);
+
+	long get_begin() const override;
+	long get_end() const override;
+	bool in_bounds(long pos) const override;
+	bool acquire(long pos, tape_segment& seg) override;
+	char get(long pos) const override;
+	void set(long pos, char c) override;
+	void clear(char blank) override;
+	void fill(long begin, long end, char c) override;
+	long view(long pos, const char *& cells) const override;
+
+	size_t get_allocated_pages() const;
+};
+
+// fixed size tape storing dense codes of its symbols, assigned as they are
+// first stored, packed at 1, 2, 4 or 8 bits per cell: the cells grow when a
+// new symbol doesn't fit. The engines run on a window of unpacked cells
+// around the head, packed back when the head leaves it; the other accesses
+// go through the window when they fall in it.
+class packed_tape : public tape_storage {
+	static const long WINDOW_SIZE;
+	static const long WINDOW_MARGIN;
+
+	std::vector<uint64_t> words;
+	long size;
+	int bits_shift = 0;		// cells of 1 << bits_shift bits
+	std::string symbols;		// symbols[code]
+	int16_t codes[transition_table::SYMBOLS];
+	std::string window;		// unpacked cells of [window_begin, window_end)
+	long window_begin = 0;
+	long window_end = 0;
+	mutable std::string scratch;	// cells decoded by view
+
+	int cell_shift() const { return 6 - bits_shift; }
+	int code_of(char c);
+	int load(long pos) const;
+	void store(long pos, int code);
+	bool unpack(long begin, long end, char *out) const;
+	void pack(long begin, long end, const char *in);
+	void widen(int shift);
+	void flush_window();
+
+public:
+	packed_tape(long size, char blank);
+
+	long get_begin() const override;
+	long get_end() const override;
+	bool in_bounds(long pos) const override;
+	bool acquire(long pos, tape_segment& seg) override;
+	char get(long pos) const override;
+	void set(long pos, char c) override;
+	void clear(char blank) override;
+	std::string read(long begin, long end) const override;
+	long view(long pos, const char *& cells) const override;
+	void reserve(const std::string& symbols) override;
+
+	int get_cell_bits() const;
+};
+
+// runs at most n steps of engine on tape, one segment at a time. Every step
+// moves the head by one cell, so a burst no longer than the distance to the
+// segment edge needs no bounds check. Only the last step of a burst can
+// leave the segment: it runs alone, and if it leaves the tape it fails with
+// out_of_memory in the state it started from, whatever the transition.
+// Returns the number of steps executed.
+template <typename Engine>
+long run_segments(const Engine& engine, tape_storage& tape, long& head, uint32_t& state, long n, run_status& status)
+{
+	tape_segment seg = { nullptr, 0, 0 };
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		if (head < seg.begin || head >= seg.end) {
+			if (!tape.acquire(head, seg)) {
+				status = run_status::out_of_memory;
+				break;
+			}
+		}
+
+		long burst = std::min(head - seg.begin, seg.end - 1 - head) + 1;
+		burst = std::min(burst, n - done);
+
+		long pos = head - seg.begin;
+		if (burst > 1)
+			done += engine.execute(seg.cells, pos, state, burst - 1, status);
+		if (status == run_status::step_limit) {
+			uint32_t from = state;
+			done += engine.execute(seg.cells, pos, state, 1, status);
+			if ((pos < 0 || pos >= seg.end - seg.begin) && !tape.in_bounds(pos + seg.begin)) {
+				state = from;
+				status = run_status::out_of_memory;
+			}
+		}
+		head = pos + seg.begin;
+
+		if (status != run_status::step_limit)
+			break;
+	}
+
+	return done;
+}
+
+#endif
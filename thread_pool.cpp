@@ -0,0 +1,128 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+// pool and index of the worker running on the current thread
+static thread_local const thread_pool *current_pool = nullptr;
+static thread_local unsigned current_index = 0;
+
+thread_pool::thread_pool(unsigned threads)
+	: next_queue(0)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < threads; i++)
+		queues.emplace_back(new worker_queue());
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&thread_pool::worker, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+	}
+	wake.notify_all();
+	for (std::thread &t : workers)
+		t.join();
+}
+
+unsigned thread_pool::size() const
+{
+	return workers.size();
+}
+
+void thread_pool::submit(task t)
+{
+	unsigned index = current_pool == this
+		? current_index
+		: next_queue++ % queues.size();
+
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(std::move(t));
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queued++;
+		pending++;
+	}
+	wake.notify_one();
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this] { return pending == 0; });
+
+	if (error) {
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+bool thread_pool::take(unsigned index, task &t)
+{
+	// newest task of our own deque first
+	{
+		worker_queue &own = *queues[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			t = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// then the oldest task of somebody else
+	for (unsigned i = 1; i < queues.size(); i++) {
+		worker_queue &victim = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			t = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void thread_pool::worker(unsigned index)
+{
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this] { return done || queued > 0; });
+			if (done)
+				return;
+		}
+
+		task t;
+		if (!take(index, t))
+			continue;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			queued--;
+		}
+
+		try {
+			t();
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (!error)
+				error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (--pending == 0)
+			idle.notify_all();
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work stealing thread pool. Every worker owns a deque: tasks submitted from
+ * a worker go to the back of its own deque and are run LIFO, idle workers
+ * steal from the front of the others. Tasks submitted from outside are
+ * spread round robin.
+ */
+class thread_pool {
+public:
+	typedef std::function<void()> task;
+
+	explicit thread_pool(unsigned threads = 0);
+	~thread_pool();
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	void submit(task t);
+
+	// blocks until every submitted task has finished, rethrows the first
+	// exception thrown by a task
+	void wait();
+
+	unsigned size() const;
+
+private:
+	struct worker_queue {
+		std::mutex lock;
+		std::deque<task> tasks;
+	};
+
+	std::vector<std::unique_ptr<worker_queue> > queues;
+	std::vector<std::thread> workers;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	long queued = 0;	// tasks waiting in the deques, guarded by lock
+	long pending = 0;	// tasks submitted and not finished yet, guarded by lock
+	bool done = false;
+	std::exception_ptr error;
+	std::atomic<unsigned> next_queue;
+
+	bool take(unsigned index, task& t);
+	void worker(unsigned index);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "threaded_program.hpp"
+
+#include <cstdint>
+
+#if defined(__GNUC__)
+#define COMPUTED_GOTO
+#endif
+
+threaded_program::threaded_program(const transition_table &table)
+	: handlers(table.get_states() << table.get_row_shift()), compact_layout(table.is_compact()),
+	  row_shift(table.get_row_shift())
+{
+	const uint8_t *columns = table.get_columns();
+	for (int c = 0; c < transition_table::SYMBOLS; c++)
+		column[c] = columns[c];
+
+	// the code addresses are only known inside run(), ask it for them
+	const void *labels[OPCODES];
+	long head = 0;
+	uint32_t state = 0;
+	run_status status;
+	if (compact_layout)
+		run<true>(nullptr, 0, nullptr, nullptr, head, state, 0, status, labels);
+	else
+		run<false>(nullptr, 0, nullptr, nullptr, head, state, 0, status, labels);
+
+	size_t width = size_t(1) << row_shift;
+	const transition_table::cell *cells = table.get_cells();
+	for (size_t s = 0; s < table.get_states(); s++) {
+		for (size_t c = 0; c < width; c++) {
+			transition_table::cell cell = cells[(s << row_shift) | c];
+			handler &h = handlers[(s << row_shift) | c];
+			uint32_t next = transition_table::next_state(cell);
+			// column 0 of a compact table writes back the symbol read
+			bool keep = compact_layout && c == 0;
+
+			if (!transition_table::is_defined(cell))
+				h.op = labels[ILLEGAL];
+			else if (transition_table::is_stop(cell))
+				h.op = labels[keep ? KEEP_HALT : HALT];
+			else
+				h.op = labels[keep ? KEEP_MOVE : MOVE];
+			h.next = &handlers[next << row_shift];
+			h.write = transition_table::write_symbol(cell);
+			h.delta = transition_table::head_delta(cell);
+		}
+	}
+}
+
+long threaded_program::execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+{
+	if (compact_layout)
+		return run<true>(handlers.data(), row_shift, column, tape, head, state, n, status, nullptr);
+	return run<false>(handlers.data(), row_shift, column, tape, head, state, n, status, nullptr);
+}
+
+template <bool compact>
+long threaded_program::run(const handler *base, int row_shift, const uint8_t *column, char *tape, long &head,
+	uint32_t &state, long n, run_status &status, const void **labels)
+{
+#ifdef COMPUTED_GOTO
+	static const void *const targets[OPCODES] = { &&op_move, &&op_halt, &&op_illegal, &&op_keep_move,
+		&&op_keep_halt };
+#define DISPATCH() do { \
+		if (steps == n) \
+			goto done; \
+		steps++; \
+		h = &block[compact ? column[static_cast<unsigned char>(tape[pos])] : static_cast<unsigned char>(tape[pos])]; \
+		goto *h->op; \
+	} while (0)
+#else
+	static const void *const targets[OPCODES] = {
+		reinterpret_cast<const void *>(static_cast<intptr_t>(MOVE)),
+		reinterpret_cast<const void *>(static_cast<intptr_t>(HALT)),
+		reinterpret_cast<const void *>(static_cast<intptr_t>(ILLEGAL)),
+		reinterpret_cast<const void *>(static_cast<intptr_t>(KEEP_MOVE)),
+		reinterpret_cast<const void *>(static_cast<intptr_t>(KEEP_HALT))
+	};
+#define DISPATCH() do { \
+		if (steps == n) \
+			goto done; \
+		steps++; \
+		h = &block[compact ? column[static_cast<unsigned char>(tape[pos])] : static_cast<unsigned char>(tape[pos])]; \
+		switch (reinterpret_cast<intptr_t>(h->op)) { \
+			case MOVE: goto op_move; \
+			case HALT: goto op_halt; \
+			case KEEP_MOVE: goto op_keep_move; \
+			case KEEP_HALT: goto op_keep_halt; \
+			default: goto op_illegal; \
+		} \
+	} while (0)
+#endif
+
+	if (labels != nullptr) {
+		for (int i = 0; i < OPCODES; i++)
+			labels[i] = targets[i];
+		return 0;
+	}
+
+	const handler *block = base + (static_cast<size_t>(state) << row_shift);
+	const handler *h;
+	long pos = head;
+	long steps = 0;
+	status = run_status::step_limit;
+
+	DISPATCH();
+
+op_move:
+	tape[pos] = h->write;
+	pos += h->delta;
+	block = h->next;
+	DISPATCH();
+
+op_halt:
+	tape[pos] = h->write;
+	pos += h->delta;
+	block = h->next;
+	status = run_status::halted;
+	goto done;
+
+op_keep_move:
+	pos += h->delta;
+	block = h->next;
+	DISPATCH();
+
+op_keep_halt:
+	pos += h->delta;
+	block = h->next;
+	status = run_status::halted;
+	goto done;
+
+op_illegal:
+	status = run_status::illegal_instruction;
+
+done:
+	head = pos;
+	state = (block - base) >> row_shift;
+	return steps;
+
+#undef DISPATCH
+}
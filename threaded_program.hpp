@@ -0,0 +1,46 @@
+#ifndef THREADED_PROGRAM_H
+#define THREADED_PROGRAM_H
+
+#include <vector>
+
+#include "transition_table.hpp"
+
+/*
+ * Direct threaded code: every (state, symbol) pair is lowered to a handler
+ * holding the address of the code to run and a pointer to the dispatch block
+ * (the handlers of the next state), so no state lookup is needed between
+ * steps. Dispatch uses computed goto where the compiler supports labels as
+ * values and falls back to a switch elsewhere.
+ *
+ * The handlers follow the layout of the table: a compact table gets one
+ * handler per column, and the handlers of column 0 leave the symbol read on
+ * the tape instead of xoring it back.
+ */
+class threaded_program {
+public:
+	enum opcode {MOVE, HALT, ILLEGAL, KEEP_MOVE, KEEP_HALT, OPCODES};
+
+	struct handler {
+		const void *op;		// label address, or the opcode with the switch fallback
+		const handler *next;	// dispatch block of the next state
+		char write;
+		signed char delta;
+	};
+
+	threaded_program(const transition_table& table);
+
+	// same contract as transition_table::execute
+	long execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const;
+
+private:
+	std::vector<handler> handlers;
+	bool compact_layout;
+	int row_shift;
+	uint8_t column[transition_table::SYMBOLS];
+
+	template <bool compact>
+	static long run(const handler *base, int row_shift, const uint8_t *column, char *tape, long &head,
+		uint32_t &state, long n, run_status &status, const void **labels);
+};
+
+#endif
@@ -2,31 +2,23 @@
 #include <iostream>
 
 tokenizer::tokenizer(const std::string& line) 
-	: line(line) 
+	: tokenizer(line.data(), line.data() + line.size())
 {
-	for (end = 0; end < line.size() && line[end] != '\n' && line[end] != '\t' && line[end] != ';'; end++);
+}
+
+tokenizer::tokenizer(const char *begin, const char *last)
+{
+	for (end = begin; end < last && *end != '\n' && *end != '\t' && *end != ';'; end++);
 
-	pos = line.find_first_not_of(' ', 0); 
+	for (pos = begin; pos < end && *pos == ' '; pos++);
 
-	if (pos == std::string::npos || pos >= end)
+	if (pos == end)
 		throw std::runtime_error("Error creating tokenizer");
 }
 
 std::string tokenizer::next_string() 
 {
-	if (pos == end || pos == std::string::npos)
-		throw std::runtime_error("No more tokens");
-
-	size_t last = line.find(' ', pos);
-	size_t start = pos;
-
-	if (last == std::string::npos || last > end) {
-		pos = end; 
-		return line.substr(start, end - start);
-	}
-
-	pos = line.find_first_not_of(' ', last); 
-	return line.substr(start, last - start);
+	return next_token().str();
 }
 
 bool tokenizer::check_symbol(char c) 
@@ -41,7 +33,7 @@ bool tokenizer::check_symbol(char c)
 
 char tokenizer::next_char() 
 {
-	return next_string()[0];
+	return next_token().data[0];
 }
 
 char tokenizer::next_symbol() 
@@ -52,11 +44,40 @@ char tokenizer::next_symbol()
 	return c;
 }
 
+// a tuple token, without the trailing comma of the comma separated syntax
+static std::string tuple_token(token t, size_t count)
+{
+	std::string tuple = t.str();
+	if (!tuple.empty() && tuple.back() == ',')
+		tuple.pop_back();
+	if (tuple.size() != count)
+		throw std::runtime_error("Syntax error: expected " + std::to_string(count) + " symbols, got " + tuple);
+	return tuple;
+}
+
+std::string tokenizer::next_symbols(size_t count)
+{
+	std::string symbols = tuple_token(next_token(), count);
+	for (char c : symbols)
+		if (!check_symbol(c))
+			throw std::runtime_error(std::string("Invalid character symbol: ") + c);
+	return symbols;
+}
+
+std::string tokenizer::next_moves(size_t count)
+{
+	std::string moves = tuple_token(next_token(), count);
+	for (char c : moves)
+		if (c != '<' && c != '>' && c != '-')
+			throw std::invalid_argument("Syntax error: invalid direction character");
+	return moves;
+}
+
 std::string tokenizer::to_end() 
 {
-	size_t begin = pos; 
+	const char *begin = pos; 
 	pos = end;
-	return line.substr(begin, end - begin);
+	return std::string(begin, end);
 }
 
 direction tokenizer::next_direction() 
@@ -1,22 +1,53 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include "turing_machine.hpp"
 
+// token inside the line being tokenized, valid as long as the line
+struct token {
+	const char *data;
+	size_t size;
+
+	std::string str() const { return std::string(data, size); }
+	bool operator==(const char *s) const { return std::strlen(s) == size && std::memcmp(data, s, size) == 0; }
+};
+
+// splits a line in tokens without copying it: the line must outlive the
+// tokenizer
 class tokenizer {
-	std::string line;	
-	size_t pos;
-	size_t end;
+	const char *pos = nullptr;
+	const char *end = nullptr;
 
 public:
 	tokenizer() = default;
 	tokenizer(const std::string& line);
+	tokenizer(const char *begin, const char *end);
+
+	token next_token()
+	{
+		if (pos == end)
+			throw std::runtime_error("No more tokens");
+
+		const char *start = pos;
+		while (pos < end && *pos != ' ')
+			pos++;
+		token t = { start, static_cast<size_t>(pos - start) };
+
+		while (pos < end && *pos == ' ')
+			pos++;
+		return t;
+	}
 
 	std::string next_string();
 	std::string to_end();
 	char next_char();
 	char next_symbol();
+	// one symbol or head move ('<', '>', '-') per tape, the token of a tuple
+	std::string next_symbols(size_t count);
+	std::string next_moves(size_t count);
 	direction next_direction();
 	unsigned long next_ulong();
 	static bool check_symbol(char c);
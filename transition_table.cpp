@@ -0,0 +1,184 @@
+#include "transition_table.hpp"
+
+const char *to_string(run_status status)
+{
+	switch (status) {
+		case run_status::halted: return "Machine reached halt state";
+		case run_status::illegal_instruction: return "Illegal instruction";
+		case run_status::out_of_memory: return "Out of memory";
+		case run_status::step_limit: return "Step limit reached";
+		case run_status::interrupted: return "Interrupted";
+		case run_status::cycling: return "Machine does not halt";
+		case run_status::translated: return "Machine does not halt (translated cycle)";
+	}
+	return "Unknown status";
+}
+
+// full tables up to this size are small enough to stay cached
+const size_t transition_table::COMPACT_THRESHOLD = 1 << 20;
+
+transition_table::transition_table()
+{
+	set_columns(FULL_ROW_SHIFT, nullptr);
+}
+
+transition_table::transition_table(const std::vector<instruction> &program, size_t states, int halt_state)
+	: states(states)
+{
+	// instructions grouped by state, in program order
+	std::vector<uint32_t> first(states + 1, 0);
+	for (const instruction &i : program)
+		first[i.from_state + 1]++;
+	for (size_t s = 0; s < states; s++)
+		first[s + 1] += first[s];
+	std::vector<const instruction *> sorted(program.size());
+	std::vector<uint32_t> next(first.begin(), first.end() - 1);
+	for (const instruction &i : program)
+		sorted[next[i.from_state]++] = &i;
+
+	bool read[SYMBOLS] = {};
+	bool explicit_wildcard = false;
+	for (const instruction &i : program) {
+		if (i.symbol_read != '-')
+			read[static_cast<unsigned char>(i.symbol_read)] = true;
+		else if (i.symbol_write != '-')
+			explicit_wildcard = true;
+	}
+
+	uint8_t columns[SYMBOLS];
+	int used = 0;
+	for (int c = 0; c < SYMBOLS; c++)
+		columns[c] = read[c] ? ++used : 0;
+	int shift = 0;
+	while ((1 << shift) < used + 1)
+		shift++;
+	bool compact = !explicit_wildcard && shift < FULL_ROW_SHIFT
+		&& states * SYMBOLS * sizeof(cell) > COMPACT_THRESHOLD;
+	set_columns(compact ? shift : FULL_ROW_SHIFT, compact ? columns : nullptr);
+
+	// the symbol read by each column, column 0 of a compact table reads
+	// symbol 0 so that the cells keeping it have a zero write field
+	char symbol[SYMBOLS] = {};
+	for (int c = 0; c < SYMBOLS; c++)
+		if (column[c] != 0 || !compact)
+			symbol[column[c]] = static_cast<char>(c);
+
+	size_t width = size_t(1) << row_shift;
+	std::shared_ptr<std::vector<cell>> owned = std::make_shared<std::vector<cell>>(states * width);
+	for (size_t s = 0; s < states; s++) {
+		// the last instruction added for a (state, symbol) pair wins
+		const instruction *exact[SYMBOLS] = {};
+		const instruction *wildcard = nullptr;
+		for (uint32_t k = first[s]; k < first[s + 1]; k++) {
+			const instruction *i = sorted[k];
+			if (i->symbol_read == '-')
+				wildcard = i;
+			else
+				exact[column[static_cast<unsigned char>(i->symbol_read)]] = i;
+		}
+
+		cell *row = owned->data() + s * width;
+		for (size_t c = 0; c < width; c++) {
+			const instruction *i = exact[c] != nullptr ? exact[c] : wildcard;
+			row[c] = i != nullptr
+				? encode(*i, symbol[c], halt_state)
+				: undefined(s, symbol[c]);
+		}
+	}
+	cells = std::shared_ptr<const cell>(owned, owned->data());
+}
+
+transition_table::transition_table(std::shared_ptr<const void> storage, const cell *data, size_t states, int row_shift,
+	const uint8_t *columns)
+	: cells(storage, data), states(states)
+{
+	set_columns(row_shift, row_shift < FULL_ROW_SHIFT ? columns : nullptr);
+}
+
+void transition_table::set_columns(int shift, const uint8_t *columns)
+{
+	row_shift = shift;
+	for (int c = 0; c < SYMBOLS; c++) {
+		column[c] = columns != nullptr ? columns[c] : c;
+		keep[c] = columns != nullptr && columns[c] == 0 ? c : 0;
+	}
+}
+
+transition_table::cell transition_table::encode(const instruction &i, char read, int halt_state)
+{
+	char write = i.symbol_write == '-' ? read : i.symbol_write;
+	cell delta = i.tape_direction == direction::L ? 0 : 2;
+	cell c = static_cast<cell>(write) | (delta << DELTA_SHIFT) | (static_cast<cell>(i.to_state) << STATE_SHIFT);
+	if (i.to_state == halt_state)
+		c |= STOP;
+	return c;
+}
+
+transition_table::cell transition_table::undefined(uint32_t state, char read)
+{
+	return static_cast<cell>(read) | STOP | (1 << DELTA_SHIFT) | (state << STATE_SHIFT);
+}
+
+size_t transition_table::get_states() const
+{
+	return states;
+}
+
+bool transition_table::is_compact() const
+{
+	return row_shift < FULL_ROW_SHIFT;
+}
+
+int transition_table::get_row_shift() const
+{
+	return row_shift;
+}
+
+const uint8_t *transition_table::get_columns() const
+{
+	return column;
+}
+
+size_t transition_table::get_size() const
+{
+	return states << row_shift;
+}
+
+const transition_table::cell *transition_table::get_cells() const
+{
+	return cells.get();
+}
+
+long transition_table::execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+{
+	return is_compact() ? run<true>(tape, head, state, n, status) : run<false>(tape, head, state, n, status);
+}
+
+template <bool compact>
+long transition_table::run(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+{
+	const cell *base = cells.get();
+	const int shift = compact ? row_shift : FULL_ROW_SHIFT;
+	long h = head;
+	uint32_t s = state;
+	long steps = 0;
+
+	status = run_status::step_limit;
+	while (steps < n) {
+		unsigned char c = static_cast<unsigned char>(tape[h]);
+		cell next = compact ? base[(s << shift) | column[c]] ^ keep[c] : base[(s << shift) | c];
+		steps++;
+
+		tape[h] = write_symbol(next);
+		h += head_delta(next);
+		s = next_state(next);
+		if (is_stop(next)) {
+			status = is_defined(next) ? run_status::halted : run_status::illegal_instruction;
+			break;
+		}
+	}
+
+	head = h;
+	state = s;
+	return steps;
+}
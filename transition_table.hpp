@@ -0,0 +1,115 @@
+#ifndef TRANSITION_TABLE_H
+#define TRANSITION_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class direction {L, R};
+
+// outcome of a batch of computation steps
+enum class run_status {
+	halted,
+	illegal_instruction,
+	out_of_memory,
+	step_limit,
+	interrupted,
+	cycling,
+	translated
+};
+
+const char *to_string(run_status status);
+
+struct instruction {
+	int from_state;
+	char symbol_read;
+	int to_state;
+	char symbol_write;
+	direction tape_direction;
+};
+
+/*
+ * Execution table compiled from a program. Every (state, symbol) pair maps
+ * to a single packed word:
+ *
+ *   bits  0-6   symbol to write (wildcard reads and '-' writes already resolved)
+ *   bit   7     stop flag: next state is the halt state or transition undefined
+ *   bits  8-9   head delta + 1 (0 left, 2 right, 1 for undefined transitions)
+ *   bits 10-31  next state
+ *
+ * An undefined transition writes back the symbol read, does not move and
+ * stays in the same state, so the hot loop never has to branch on validity.
+ *
+ * Large programs reading few symbols get a compact table: the symbols read
+ * by their instructions are remapped to dense columns, column 0 stands for
+ * every other symbol and rows are padded to a power of two. Column 0 cells
+ * keeping the symbol read hold a zero write field, and the symbol is xored
+ * back in by the lookup. A program with a wildcard instruction writing an
+ * explicit symbol has no such column and keeps the full table.
+ *
+ * The cells are immutable once built and shared by the copies of a table.
+ * They are either owned or borrowed from a mapped binary program, kept
+ * alive by the storage handle.
+ */
+class transition_table {
+public:
+	typedef uint32_t cell;
+
+	static const int SYMBOLS = 128;
+	static const uint32_t MAX_STATES = 1u << 22;
+
+	transition_table();
+	transition_table(const std::vector<instruction>& program, size_t states, int halt_state);
+	// cells laid out by a table with the given row shift and columns
+	transition_table(std::shared_ptr<const void> storage, const cell *cells, size_t states, int row_shift,
+		const uint8_t *columns);
+
+	size_t get_states() const;
+	cell get_cell(uint32_t state, char symbol) const
+	{
+		unsigned char c = static_cast<unsigned char>(symbol);
+		return cells.get()[(state << row_shift) | column[c]] ^ keep[c];
+	}
+
+	// layout of the cells: rows of 1 << row_shift cells, column of every symbol
+	bool is_compact() const;
+	int get_row_shift() const;
+	const uint8_t *get_columns() const;
+	size_t get_size() const;
+	const cell *get_cells() const;
+
+	// executes at most n steps, returns the number of steps executed.
+	// The caller guarantees the head stays inside the tape for n steps.
+	long execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const;
+
+	static char write_symbol(cell c) { return static_cast<char>(c & WRITE_MASK); }
+	static int head_delta(cell c) { return static_cast<int>((c >> DELTA_SHIFT) & 3) - 1; }
+	static uint32_t next_state(cell c) { return c >> STATE_SHIFT; }
+	static bool is_stop(cell c) { return (c & STOP) != 0; }
+	static bool is_defined(cell c) { return head_delta(c) != 0; }
+
+private:
+	static const cell WRITE_MASK = 0x7f;
+	static const cell STOP = 0x80;
+	static const int DELTA_SHIFT = 8;
+	static const int STATE_SHIFT = 10;
+
+	static const int FULL_ROW_SHIFT = 7;
+	static const size_t COMPACT_THRESHOLD;
+
+	static cell encode(const instruction& i, char read, int halt_state);
+	static cell undefined(uint32_t state, char read);
+
+	void set_columns(int row_shift, const uint8_t *columns);
+	template <bool compact>
+	long run(char *tape, long &head, uint32_t &state, long n, run_status &status) const;
+
+	std::shared_ptr<const cell> cells;
+	size_t states = 0;
+	int row_shift = FULL_ROW_SHIFT;
+	uint8_t column[SYMBOLS];
+	cell keep[SYMBOLS];
+};
+
+#endif
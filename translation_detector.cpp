@@ -0,0 +1,109 @@
+#include "translation_detector.hpp"
+
+#include <algorithm>
+
+// cells behind a record compared with the older records, and records kept
+// per side: longer periods or wider sweeps are not detected
+const long translation_detector::WINDOW_LIMIT = 4096;
+const size_t translation_detector::RECORD_HISTORY = 64;
+
+translation_detector::translation_detector(const transition_table &table, const tape_storage &tape, long head)
+	: table(table), low(head), high(head)
+{
+	tape.data_extent(low, high);
+	right = { 1, head, {} };
+	left = { -1, -head, {} };
+}
+
+bool translation_detector::on_record(side &s, const tape_storage &tape, long head, uint32_t state)
+{
+	long pos = s.sign * head;
+	long lowest = s.sign > 0 ? low : -high;
+	long len = std::min(WINDOW_LIMIT, pos - lowest + 1);
+
+	record r = { state, steps, pos, s.trough, "" };
+	if (s.sign > 0) {
+		r.cells = tape.read(head - len + 1, head + 1);
+		std::reverse(r.cells.begin(), r.cells.end());
+	} else {
+		r.cells = tape.read(head, head + len);
+	}
+	s.trough = pos;
+
+	// walk back the older records keeping the lowest position visited since
+	// each of them, the cells from there to the record must match
+	long trough = r.trough;
+	for (auto i = s.records.rbegin(); i != s.records.rend(); ++i) {
+		long needed = i->pos - trough + 1;
+		if (i->state == state && needed <= static_cast<long>(i->cells.size())
+			&& r.cells.compare(0, needed, i->cells, 0, needed) == 0) {
+			entry = i->step;
+			length = steps - i->step;
+			shift = s.sign * (pos - i->pos);
+			return true;
+		}
+		trough = std::min(trough, i->trough);
+	}
+
+	s.records.push_back(std::move(r));
+	if (s.records.size() > RECORD_HISTORY)
+		s.records.pop_front();
+	return false;
+}
+
+long translation_detector::run(tape_storage &tape, long &head, uint32_t &state, long n, run_status &status)
+{
+	tape_segment seg = { nullptr, 0, 0 };
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		if (head < seg.begin || head >= seg.end) {
+			if (!tape.acquire(head, seg)) {
+				status = run_status::out_of_memory;
+				break;
+			}
+		}
+
+		char &c = seg.cells[head - seg.begin];
+		transition_table::cell next = table.get_cell(state, c);
+		done++;
+		if (!transition_table::is_defined(next)) {
+			status = run_status::illegal_instruction;
+			break;
+		}
+
+		c = transition_table::write_symbol(next);
+		head += transition_table::head_delta(next);
+		if ((head < seg.begin || head >= seg.end) && !tape.in_bounds(head)) {
+			status = run_status::out_of_memory;
+			break;
+		}
+		state = transition_table::next_state(next);
+		if (transition_table::is_stop(next)) {
+			status = run_status::halted;
+			break;
+		}
+		if (observe(tape, head, state)) {
+			status = run_status::translated;
+			break;
+		}
+	}
+
+	return done;
+}
+
+long translation_detector::get_entry() const
+{
+	return entry;
+}
+
+long translation_detector::get_length() const
+{
+	return length;
+}
+
+long translation_detector::get_shift() const
+{
+	return shift;
+}
@@ -0,0 +1,89 @@
+#ifndef TRANSLATION_DETECTOR_H
+#define TRANSLATION_DETECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+
+/*
+ * Detects translated cycles: machines repeating the same behaviour shifted
+ * by a few cells at every period while drifting over blank tape.
+ *
+ * Only record breaking steps (the head reaching a new leftmost or rightmost
+ * cell) are examined. Two records on the same side in the same state, where
+ * the tape between the record cell and the farthest cell visited back since
+ * the older one is the same, prove that the machine repeats forever: the
+ * cells ahead of a record are always blank. Steps inside the visited extent
+ * only cost two comparisons.
+ *
+ * A drifting machine always leaves a bounded tape, so the detector is meant
+ * for unbounded tapes.
+ */
+class translation_detector {
+	static const long WINDOW_LIMIT;
+	static const size_t RECORD_HISTORY;
+
+	struct record {
+		uint32_t state;
+		long step;
+		long pos;		// in side coordinates, growing with the records
+		long trough;		// lowest position since the previous record
+		std::string cells;	// cells[k] is the cell at pos - k
+	};
+
+	// records on one side, positions are negated on the left one so both
+	// sides grow towards higher positions
+	struct side {
+		int sign;
+		long trough;
+		std::deque<record> records;
+	};
+
+	const transition_table& table;
+	long steps = 0;
+	long low, high;		// extent of the visited and non blank cells
+	side right, left;
+
+	long entry = -1;
+	long length = -1;
+	long shift = 0;
+
+	bool on_record(side& s, const tape_storage& tape, long head, uint32_t state);
+
+public:
+	translation_detector(const transition_table& table, const tape_storage& tape, long head);
+
+	// to be called after every step, true once a translated cycle is proven
+	bool observe(const tape_storage& tape, long head, uint32_t state)
+	{
+		steps++;
+		right.trough = std::min(right.trough, head);
+		left.trough = std::min(left.trough, -head);
+		if (head > high) {
+			high = head;
+			return on_record(right, tape, head, state);
+		}
+		if (head < low) {
+			low = head;
+			return on_record(left, tape, head, state);
+		}
+		return false;
+	}
+
+	// same contract as run_segments, stops with run_status::translated when a
+	// translated cycle is proven
+	long run(tape_storage& tape, long& head, uint32_t& state, long n, run_status& status);
+
+	// steps from the start of the detection to the first record of the cycle,
+	// length of the cycle in steps and cells shifted at each period (negative
+	// to the left). Valid once a cycle is found
+	long get_entry() const;
+	long get_length() const;
+	long get_shift() const;
+};
+
+#endif
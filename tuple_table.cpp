@@ -0,0 +1,168 @@
+#include "tuple_table.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// a gigabyte of table
+const size_t tuple_table::MAX_WORDS = size_t(1) << 28;
+
+tuple_table::tuple_table()
+{
+}
+
+tuple_table::tuple_table(const std::vector<tuple_instruction> &program, size_t states, int tapes, int halt_state)
+	: tapes(tapes)
+{
+	bool read[transition_table::SYMBOLS] = {};
+	for (const tuple_instruction &i : program)
+		for (char c : i.symbols_read)
+			if (c != '-')
+				read[static_cast<unsigned char>(c)] = true;
+	for (int c = 0; c < transition_table::SYMBOLS; c++)
+		column[c] = read[c] ? width++ : 0;
+
+	for (int t = 0; t < tapes; t++)
+		row *= width;
+	size_t stride = tapes + 1;
+	if (row * stride > MAX_WORDS / std::max(states, size_t(1)))
+		throw std::runtime_error("Too many symbols read by the instructions for " + std::to_string(tapes) + " tapes");
+
+	words.resize(states * row * stride);
+	for (size_t s = 0; s < states; s++) {
+		for (size_t e = 0; e < row; e++) {
+			uint32_t *entry = &words[(s * row + e) * stride];
+			entry[0] = STOP | UNDEFINED | static_cast<uint32_t>(s) << STATE_SHIFT;
+			for (int t = 0; t < tapes; t++)
+				entry[t + 1] = KEEP | 1 << DELTA_SHIFT;
+		}
+	}
+
+	// the more specific instructions are filled in last and win
+	std::vector<const tuple_instruction *> sorted;
+	for (const tuple_instruction &i : program)
+		sorted.push_back(&i);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const tuple_instruction *a, const tuple_instruction *b) {
+		return std::count(a->symbols_read.begin(), a->symbols_read.end(), '-')
+			> std::count(b->symbols_read.begin(), b->symbols_read.end(), '-');
+	});
+
+	for (const tuple_instruction *i : sorted) {
+		uint32_t next = static_cast<uint32_t>(i->to_state) << STATE_SHIFT;
+		if (i->to_state == halt_state)
+			next |= STOP;
+		uint32_t action[MAX_TAPES];
+		for (int t = 0; t < tapes; t++) {
+			char w = i->symbols_write[t];
+			uint32_t delta = i->moves[t] == '<' ? 0 : i->moves[t] == '>' ? 2 : 1;
+			action[t] = (w == '-' ? KEEP : static_cast<uint32_t>(w)) | delta << DELTA_SHIFT;
+		}
+
+		// every tuple of columns matched, the wildcards running over all of them
+		size_t current[MAX_TAPES];
+		for (int t = 0; t < tapes; t++)
+			current[t] = i->symbols_read[t] == '-' ? 0 : column[static_cast<unsigned char>(i->symbols_read[t])];
+		while (true) {
+			size_t e = 0;
+			for (int t = tapes - 1; t >= 0; t--)
+				e = e * width + current[t];
+			uint32_t *entry = &words[(i->from_state * row + e) * stride];
+			entry[0] = next;
+			std::copy(action, action + tapes, entry + 1);
+
+			int t = 0;
+			while (t < tapes && (i->symbols_read[t] != '-' || current[t] + 1 == width)) {
+				if (i->symbols_read[t] == '-')
+					current[t] = 0;
+				t++;
+			}
+			if (t == tapes)
+				break;
+			current[t]++;
+		}
+	}
+}
+
+int tuple_table::get_tapes() const
+{
+	return tapes;
+}
+
+long tuple_table::execute(char *const *tape, long *heads, uint32_t &state, long n, run_status &status) const
+{
+	const uint32_t *base = words.data();
+	const size_t stride = tapes + 1;
+	long h[MAX_TAPES];
+	std::copy(heads, heads + tapes, h);
+	uint32_t s = state;
+	long steps = 0;
+
+	status = run_status::step_limit;
+	while (steps < n) {
+		size_t e = 0;
+		for (int t = tapes - 1; t >= 0; t--)
+			e = e * width + column[static_cast<unsigned char>(tape[t][h[t]])];
+		const uint32_t *entry = base + (s * row + e) * stride;
+		steps++;
+
+		for (int t = 0; t < tapes; t++) {
+			uint32_t action = entry[t + 1];
+			char &cell = tape[t][h[t]];
+			cell = (action & KEEP) != 0 ? cell : static_cast<char>(action & WRITE_MASK);
+			h[t] += static_cast<long>((action >> DELTA_SHIFT) & 3) - 1;
+		}
+		s = entry[0] >> STATE_SHIFT;
+		if ((entry[0] & STOP) != 0) {
+			status = (entry[0] & UNDEFINED) != 0 ? run_status::illegal_instruction : run_status::halted;
+			break;
+		}
+	}
+
+	std::copy(h, h + tapes, heads);
+	state = s;
+	return steps;
+}
+
+long tuple_table::run_segments(tape_storage *const *tape, long *heads, uint32_t &state, long n,
+	run_status &status) const
+{
+	tape_segment seg[MAX_TAPES] = {};
+	char *cells[MAX_TAPES];
+	long pos[MAX_TAPES];
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		long burst = n - done;
+		for (int t = 0; t < tapes; t++) {
+			if (heads[t] < seg[t].begin || heads[t] >= seg[t].end) {
+				if (!tape[t]->acquire(heads[t], seg[t])) {
+					status = run_status::out_of_memory;
+					return done;
+				}
+			}
+			burst = std::min(burst, std::min(heads[t] - seg[t].begin, seg[t].end - 1 - heads[t]) + 1);
+			cells[t] = seg[t].cells;
+			pos[t] = heads[t] - seg[t].begin;
+		}
+
+		if (burst > 1)
+			done += execute(cells, pos, state, burst - 1, status);
+		if (status == run_status::step_limit) {
+			uint32_t from = state;
+			done += execute(cells, pos, state, 1, status);
+			for (int t = 0; t < tapes; t++) {
+				if ((pos[t] < 0 || pos[t] >= seg[t].end - seg[t].begin) && !tape[t]->in_bounds(pos[t] + seg[t].begin)) {
+					state = from;
+					status = run_status::out_of_memory;
+				}
+			}
+		}
+		for (int t = 0; t < tapes; t++)
+			heads[t] = pos[t] + seg[t].begin;
+
+		if (status != run_status::step_limit)
+			break;
+	}
+
+	return done;
+}
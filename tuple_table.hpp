@@ -0,0 +1,72 @@
+#ifndef TUPLE_TABLE_H
+#define TUPLE_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+
+// instruction of a machine with several tapes, one character per tape
+struct tuple_instruction {
+	int from_state;
+	std::string symbols_read;	// '-' reads any symbol
+	int to_state;
+	std::string symbols_write;	// '-' writes back the symbol read
+	std::string moves;		// '<' left, '>' right, '-' stays
+};
+
+/*
+ * Execution table of a machine with k tapes. The symbols read by the
+ * instructions get the columns 1 to S - 1, column 0 stands for every other
+ * symbol, and the symbols under the heads select the entry
+ *
+ *   column(c0) + S * column(c1) + ... + S^(k-1) * column(ck-1)
+ *
+ * of the row of the state, so a step is a single lookup whatever k is. An
+ * entry is k + 1 words, the next state followed by the action on each tape:
+ *
+ *   state word   bit 0 stop flag, bit 1 undefined transition, bits 2-31 next state
+ *   tape word    bits 0-6 symbol to write, bit 7 write back the symbol read,
+ *                bits 8-9 head delta + 1
+ *
+ * An undefined transition keeps the symbols and the heads and stops. Among
+ * the instructions of a state matching the same symbols, the one reading
+ * fewer wildcards wins, the last one added among equals.
+ */
+class tuple_table {
+public:
+	static const int MAX_TAPES = 4;
+
+	tuple_table();
+	tuple_table(const std::vector<tuple_instruction>& program, size_t states, int tapes, int halt_state);
+
+	int get_tapes() const;
+
+	// executes at most n steps, returns the number of steps executed.
+	// The caller guarantees every head stays inside its tape for n steps.
+	long execute(char *const *tape, long *heads, uint32_t &state, long n, run_status &status) const;
+
+	// same as run_segments, with a segment per tape: the bursts end when
+	// the head nearest to the edge of its segment could leave it, and a step
+	// taking any head off its tape fails with out_of_memory
+	long run_segments(tape_storage *const *tape, long *heads, uint32_t &state, long n, run_status &status) const;
+
+private:
+	static const uint32_t STOP = 1;
+	static const uint32_t UNDEFINED = 2;
+	static const int STATE_SHIFT = 2;
+	static const uint32_t WRITE_MASK = 0x7f;
+	static const uint32_t KEEP = 0x80;
+	static const int DELTA_SHIFT = 8;
+	static const size_t MAX_WORDS;
+
+	std::vector<uint32_t> words;
+	int tapes = 1;
+	size_t width = 1;	// S, columns per tape
+	size_t row = 1;		// S^k, entries per state
+	uint8_t column[transition_table::SYMBOLS] = {};
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "turing_machine.hpp"
+#include "macro_machine.hpp"
 
 #include <cstdlib>
+#include <climits>
 #include <stdexcept>
 #include <algorithm>
 #include <cassert> 
@@ -9,10 +11,23 @@ const int turing_machine::HALT_STATE = 0;
 const int turing_machine::INIT_STATE = 1; 
 const char * turing_machine::halt_state_name = "!";
 const char * turing_machine::init_state_name = "$";
+const long turing_machine::INTERRUPT_CHECK_INTERVAL = 4096;
+
+const char *to_string(engine_type engine)
+{
+	switch (engine) {
+		case engine_type::table: return "table";
+		case engine_type::threaded: return "threaded";
+		case engine_type::rle: return "rle";
+		case engine_type::native: return "native";
+	}
+	return "unknown";
+}
 
 // constructors
 turing_machine::turing_machine(long memory_size, char initial_symbol) 
-	: tape(memory_size, initial_symbol), head_pos(initial_symbol/2), initial_symbol(initial_symbol) 
+	: tape(new fixed_tape(memory_size, initial_symbol)), mode(tape_mode::fixed), 
+	head_pos(initial_symbol/2), initial_symbol(initial_symbol) 
 {
 	reset();
 }
@@ -20,12 +35,15 @@ turing_machine::turing_machine(long memory_size, char initial_symbol)
 // state condifications functions
 int turing_machine::get_state_code(const std::string &name) 
 {
-	if (state_code.count(name))
-		return state_code[name];
-	int code = state_code.size();
-	state_code[name] = code;
+	auto known = state_code.emplace(name, state_code.size());
+	if (!known.second)
+		return known.first->second;
+	if (state_code.size() > transition_table::MAX_STATES) {
+		state_code.erase(known.first);
+		throw std::runtime_error("Too many states");
+	}
 	state_name.push_back(name);
-	return code;
+	return known.first->second;
 }
 
 std::string turing_machine::get_state_name(int code) const 
@@ -34,68 +52,277 @@ std::string turing_machine::get_state_name(int code) const
 }
 
 // program manipulation
+static void check_tape_symbol(char c)
+{
+	if (static_cast<unsigned char>(c) >= transition_table::SYMBOLS)
+		throw std::runtime_error(std::string("Invalid tape symbol: ") + c);
+}
+
 void turing_machine::add_instruction(const std::string &from, char read, const std::string &to, char write, direction dir) 
 {
+	if (tape_count > 1)
+		throw std::runtime_error("The machine has " + std::to_string(tape_count) + " tapes, add one symbol per tape");
+	check_tape_symbol(read);
+	check_tape_symbol(write);
+
 	int code_from = get_state_code(from);
 	int code_to = get_state_code(to);
 	
-	instruction i = { true, code_from, read, code_to, write, dir };
+	instruction i = { code_from, read, code_to, write, dir };
 	program.push_back(i);
+	program_lines.clear();
+	table_dirty = true;
+	forget_history();
+}
 
-	if (state_name.size() > table.size()) {
-		table.resize(state_name.size());
+void turing_machine::add_instruction(const std::string &from, const std::string &read, const std::string &to,
+	const std::string &write, const std::string &moves)
+{
+	if (tape_count == 1)
+		throw std::runtime_error("The machine has a single tape");
+	size_t k = tape_count;
+	if (read.size() != k || write.size() != k || moves.size() != k)
+		throw std::runtime_error("The instructions read, write and move " + std::to_string(k) + " symbols");
+	for (size_t t = 0; t < k; t++) {
+		check_tape_symbol(read[t]);
+		check_tape_symbol(write[t]);
+		if (moves[t] != '<' && moves[t] != '>' && moves[t] != '-')
+			throw std::runtime_error(std::string("Invalid head move: ") + moves[t]);
 	}
 
-	table[code_from][i.symbol_read] = i;
+	int code_from = get_state_code(from);
+	int code_to = get_state_code(to);
+
+	tuple_program.push_back({ code_from, read, code_to, write, moves });
+	program_lines.clear();
+	table_dirty = true;
+	forget_history();
 }
 
 void turing_machine::del_instruction(int index) 
 {
-	const instruction &i = program[index];
-	table[i.from_state][i.symbol_read].is_valid = false;
-	program.erase(program.begin() + index - 1);
+	if (index < 1 || index > static_cast<int>(get_program_size()))
+		throw std::runtime_error("Invalid instruction number");
+	if (tape_count > 1)
+		tuple_program.erase(tuple_program.begin() + index - 1);
+	else
+		program.erase(program.begin() + index - 1);
+	program_lines.clear();
+	table_dirty = true;
+	forget_history();
 }
 
 void turing_machine::clear_program() 
 {
 	program.clear();
-	std::fill(table.begin(), table.end(), std::array<instruction, 128>());
+	tuple_program.clear();
+	program_lines.clear();
+	table_dirty = true;
+	forget_history();
+}
+
+// symbols the machine can write on the tape
+std::string turing_machine::get_alphabet() const
+{
+	bool used[transition_table::SYMBOLS] = {};
+	used[static_cast<unsigned char>(initial_symbol)] = true;
+	for (const instruction &i : program) {
+		if (i.symbol_read != '-')
+			used[static_cast<unsigned char>(i.symbol_read)] = true;
+		if (i.symbol_write != '-')
+			used[static_cast<unsigned char>(i.symbol_write)] = true;
+	}
+	for (const tuple_instruction &i : tuple_program)
+		for (char c : i.symbols_read + i.symbols_write)
+			if (c != '-')
+				used[static_cast<unsigned char>(c)] = true;
+
+	std::string alphabet;
+	for (int c = 0; c < transition_table::SYMBOLS; c++)
+		if (used[c])
+			alphabet += static_cast<char>(c);
+	return alphabet;
+}
+
+void turing_machine::build_table()
+{
+	if (tape_count > 1) {
+		if (table_dirty) {
+			tuples = tuple_table(tuple_program, state_name.size(), tape_count, HALT_STATE);
+			std::string alphabet = get_alphabet();
+			for (int t = 0; t < tape_count; t++)
+				get_tape_storage(t).reserve(alphabet);
+			table_dirty = false;
+		}
+		return;
+	}
+
+	if (table_dirty) {
+		table = transition_table(program, state_name.size(), HALT_STATE);
+		tape->reserve(get_alphabet());
+		native.reset();
+		threaded.reset();
+		if (prof)
+			prof->clear();
+		table_dirty = false;
+	}
+	if (engine == engine_type::native && !native)
+		native = native_program::compile(table);
+	if (engine == engine_type::threaded && !threaded)
+		threaded.reset(new threaded_program(table));
+}
+
+// the history is only valid while the machine is changed by running it
+void turing_machine::forget_history()
+{
+	rle.reset();
+	if (undo)
+		undo->clear(computation_steps);
+}
+
+tape_storage &turing_machine::get_tape_storage(int t) const
+{
+	if (t < 0 || t >= tape_count)
+		throw std::runtime_error("Invalid tape number");
+	return t == 0 ? *tape : *extra_tapes[t - 1];
+}
+
+// the other tapes are made like the first one, their heads start at its head
+void turing_machine::create_extra_tapes()
+{
+	extra_tapes.clear();
+	extra_heads.clear();
+	std::string alphabet = get_alphabet();
+	for (int t = 1; t < tape_count; t++) {
+		extra_tapes.emplace_back(tape_storage::create(mode, get_tape_length(), initial_symbol));
+		extra_tapes.back()->reserve(alphabet);
+		extra_heads.push_back(head_pos);
+	}
+}
+
+void turing_machine::check_single_tape(const char *feature) const
+{
+	if (tape_count > 1)
+		throw std::runtime_error(std::string("Not supported on multi-tape machines: ") + feature);
 }
 
 // machine settings
 void turing_machine::set_memory_size(long memory_size) 
 {
-	tape.resize(memory_size);
+	tape.reset(tape_storage::create(mode, memory_size, initial_symbol));
+	tape->reserve(get_alphabet());
 	head_pos = memory_size / 2;
+	create_extra_tapes();
+	reset();
+}
+
+void turing_machine::set_tape_mode(tape_mode m)
+{
+	mode = m;
+	tape.reset(tape_storage::create(mode, get_tape_length(), initial_symbol));
+	tape->reserve(get_alphabet());
+	create_extra_tapes();
+	reset();
+}
+
+void turing_machine::set_tape_count(int count)
+{
+	if (count < 1 || count > tuple_table::MAX_TAPES)
+		throw std::runtime_error("The machine has 1 to " + std::to_string(tuple_table::MAX_TAPES) + " tapes");
+	if (count > 1 && (undo || prof))
+		throw std::runtime_error(std::string("Not supported on multi-tape machines: ") + (undo ? "the undo log" : "profiling"));
+	if (count == tape_count)
+		return;
+
+	// the instructions read one symbol per tape
+	clear_program();
+	tape_count = count;
+	create_extra_tapes();
 	reset();
 }
 
-void turing_machine::set_head_position(long pos) 
+void turing_machine::set_engine(engine_type e)
+{
+	engine = e;
+}
+
+void turing_machine::set_undo_log(size_t capacity)
+{
+	if (capacity == 0) {
+		undo.reset();
+		return;
+	}
+	check_single_tape("the undo log");
+	undo.reset(new undo_log(capacity));
+	forget_history();
+}
+
+void turing_machine::set_profiling(bool enabled)
+{
+	if (!enabled) {
+		prof.reset();
+		return;
+	}
+	check_single_tape("profiling");
+	if (!prof)
+		prof.reset(new profiler());
+}
+
+void turing_machine::clear_profile()
+{
+	if (!prof)
+		throw std::runtime_error("Profiling disabled");
+	prof->clear();
+}
+
+const native_program &turing_machine::compile_native()
+{
+	check_single_tape("native code");
+	engine = engine_type::native;
+	build_table();
+	return *native;
+}
+
+void turing_machine::set_head_position(long pos, int t) 
 {
-	head_pos = pos;
+	get_tape_storage(t);
+	if (t == 0)
+		head_pos = pos;
+	else
+		extra_heads[t - 1] = pos;
+	forget_history();
 }
 
-void turing_machine::set_tape(long pos, const std::string &str) 
+void turing_machine::set_tape(long pos, const std::string &str, int t) 
 {
-	tape.replace(pos, str.size(), str);
+	tape_storage &storage = get_tape_storage(t);
+	for (char c : str)
+		check_tape_symbol(c);
+	for (size_t i = 0; i < str.size(); i++)
+		storage.set(pos + i, str[i]);
+	forget_history();
 }
 
 void turing_machine::set_tape(long pos, char c) 
 {
-	tape.at(pos) = c; 
+	check_tape_symbol(c);
+	tape->set(pos, c);
+	forget_history();
 }
 
 void turing_machine::set_state(const std::string &state) 
 {
-	if (state_code.count(state)) 
-		current_state = state_code[state];
-	else 
+	auto known = state_code.find(state);
+	if (known == state_code.end())
 		throw std::runtime_error("Non existent state!");
+	current_state = known->second;
 	is_halt = false;
+	forget_history();
 }
 
 void turing_machine::set_initial_symbol(char init) 
 {
+	check_tape_symbol(init);
 	initial_symbol = init;
 	reset();
 }
@@ -103,89 +330,435 @@ void turing_machine::set_initial_symbol(char init)
 // machine control 
 void turing_machine::reset() 
 {
-	fill(tape.begin(), tape.end(), initial_symbol);
+	tape->clear(initial_symbol);
+	for (std::unique_ptr<tape_storage> &t : extra_tapes)
+		t->clear(initial_symbol);
 	computation_steps = 0; 
 	current_state = turing_machine::INIT_STATE;
 	is_halt = false;
+	forget_history();
 }
 
-bool turing_machine::step() 
+void turing_machine::check_runnable() const
 {
 	if (is_halt) 
 		throw std::runtime_error("The machine is halted");
 
-	if (table.size() < 1) 
+	if (get_program_size() == 0) 
 		throw std::runtime_error("Program empty!");
-	
-	// increase number of steps
-	computation_steps++;
+}
+
+bool turing_machine::step() 
+{
+	check_runnable();
+
+	switch (run_batch(1)) {
+		case run_status::illegal_instruction: throw std::runtime_error("Illegal instruction");
+		case run_status::out_of_memory: throw std::runtime_error("Out of memory");
+		case run_status::halted: return false;
+		default: return true;
+	}
+}
+
+void turing_machine::back(long n)
+{
+	if (!undo)
+		throw std::runtime_error("Undo log disabled");
+
+	build_table();
+
+	uint32_t state = current_state;
+	if (!undo->back(table, n, *tape, head_pos, state))
+		throw std::runtime_error("Not enough history to go back " + std::to_string(n) + " steps");
+	computation_steps -= n;
+	current_state = state;
+	is_halt = false;
+}
+
+run_status turing_machine::run(long max_steps, const std::atomic<bool> *interrupt)
+{
+	if (is_halt)
+		return run_status::halted;
+
+	if (get_program_size() == 0)
+		return run_status::illegal_instruction;
+
+	// the rle engine doesn't record nor profile its steps, multi-tape
+	// machines always run on their table
+	if (engine == engine_type::rle && !undo && !prof && tape_count == 1)
+		return run_rle(max_steps, interrupt);
+
+	// run in batches, checking for interruption only between them
+	while (max_steps != 0) {
+		long n = INTERRUPT_CHECK_INTERVAL;
+		if (max_steps > 0 && max_steps < n)
+			n = max_steps;
+
+		run_status status = run_batch(n);
+		if (status != run_status::step_limit)
+			return status;
+
+		if (max_steps > 0)
+			max_steps -= n;
+		if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed))
+			return run_status::interrupted;
+	}
+
+	return run_status::step_limit;
+}
+
+run_status turing_machine::step_n(long n, const std::atomic<bool> *interrupt)
+{
+	return run(n, interrupt);
+}
+
+run_status turing_machine::run_macro(int block_size, long max_steps, const std::atomic<bool> *interrupt)
+{
+	check_single_tape("macro machine runs");
+	if (block_size < 1)
+		throw std::runtime_error("Invalid block size");
+
+	if (is_halt)
+		return run_status::halted;
 
-	// read a character from tape
-	char c = tape[head_pos];
+	if (program.empty())
+		return run_status::illegal_instruction;
 
-	// get next transition
-	instruction next = table[current_state][c];
+	build_table();
 
-	// check if instruction is valid
-	if (!next.is_valid)
-		next = table[current_state]['-'];
-	if (!next.is_valid) {
+	macro_machine macro(table, block_size);
+	uint32_t state = current_state;
+	long steps = 0;
+	run_status status = macro.run(*tape, mode != tape_mode::unbounded, head_pos, state, steps, max_steps, interrupt);
+	computation_steps += steps;
+	current_state = state;
+	forget_history();
+
+	// an unbounded tape stores the head cell, as after running on the table
+	tape_segment seg;
+	tape->acquire(head_pos, seg);
+
+	// the machine loops inside a block or the budget ends inside one:
+	// finish one step at a time
+	if (status == run_status::step_limit && (max_steps < 0 || steps < max_steps))
+		return run(max_steps < 0 ? -1 : max_steps - steps, interrupt);
+
+	if (status != run_status::step_limit && status != run_status::interrupted)
 		is_halt = true;
-		throw std::runtime_error("Illegal instruction");
+
+	return status;
+}
+
+run_status turing_machine::run_cycle_check(long max_steps, const std::atomic<bool> *interrupt, bool check_translations)
+{
+	check_single_tape("cycle detection");
+	if (check_translations && mode != tape_mode::unbounded)
+		throw std::runtime_error("Translated cycle detection needs an unbounded tape");
+
+	if (is_halt)
+		return run_status::halted;
+
+	if (program.empty())
+		return run_status::illegal_instruction;
+
+	build_table();
+
+	// the cycle detector passes its steps on to the translation detector
+	struct both_detectors {
+		cycle_detector cycles;
+		std::unique_ptr<translation_detector> translation;
+
+		long run(tape_storage &tape, long &head, uint32_t &state, long n, run_status &status)
+		{
+			return cycles.run(tape, head, state, n, status, translation.get());
+		}
+	} detector{cycle_detector(table, *tape, head_pos, current_state), nullptr};
+	if (check_translations)
+		detector.translation.reset(new translation_detector(table, *tape, head_pos));
+
+	long start = computation_steps;
+	run_status status = run_detector(detector, max_steps, interrupt);
+	if (status == run_status::cycling) {
+		cycle_entry = start + detector.cycles.get_entry();
+		cycle_length = detector.cycles.get_length();
+		cycle_shift = 0;
+	} else if (status == run_status::translated) {
+		cycle_entry = start + detector.translation->get_entry();
+		cycle_length = detector.translation->get_length();
+		cycle_shift = detector.translation->get_shift();
 	}
 
-	// write new char to tape
-	if (next.symbol_write == '-')
-		tape[head_pos] = c;
-	else 
-		tape[head_pos] = next.symbol_write;
-	
-	// move tape head
-	switch (next.tape_direction) {
-		case direction::L: head_pos--; break;
-		case direction::R: head_pos++; break;
+	return status;
+}
+
+run_status turing_machine::run_translation_check(long max_steps, const std::atomic<bool> *interrupt)
+{
+	check_single_tape("translated cycle detection");
+	if (mode != tape_mode::unbounded)
+		throw std::runtime_error("Translated cycle detection needs an unbounded tape");
+
+	if (is_halt)
+		return run_status::halted;
+
+	if (program.empty())
+		return run_status::illegal_instruction;
+
+	build_table();
+
+	translation_detector detector(table, *tape, head_pos);
+	long start = computation_steps;
+	run_status status = run_detector(detector, max_steps, interrupt);
+	if (status == run_status::translated) {
+		cycle_entry = start + detector.get_entry();
+		cycle_length = detector.get_length();
+		cycle_shift = detector.get_shift();
+	}
+
+	return status;
+}
+
+template <typename Detector>
+run_status turing_machine::run_detector(Detector &detector, long max_steps, const std::atomic<bool> *interrupt)
+{
+	uint32_t state = current_state;
+	run_status status = run_status::step_limit;
+
+	while (max_steps != 0) {
+		long n = INTERRUPT_CHECK_INTERVAL;
+		if (max_steps > 0 && max_steps < n)
+			n = max_steps;
+
+		computation_steps += detector.run(*tape, head_pos, state, n, status);
+		current_state = state;
+		if (status != run_status::step_limit)
+			break;
+
+		if (max_steps > 0)
+			max_steps -= n;
+		if (interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+			status = run_status::interrupted;
+			break;
+		}
 	}
 
-	// check if out of bound
-	if (head_pos < 0 || head_pos >= get_tape_length()) {
+	forget_history();
+
+	// a machine proven not to halt can still be stepped
+	if (status == run_status::halted || status == run_status::illegal_instruction
+		|| status == run_status::out_of_memory)
 		is_halt = true;
-		throw std::runtime_error("Out of memory");
+
+	return status;
+}
+
+std::vector<batch_result> turing_machine::run_inputs(const std::vector<std::string> &inputs, long max_steps,
+	int window, bool check_cycles, bool check_translations, unsigned threads, const std::atomic<bool> *interrupt)
+{
+	check_single_tape("batch runs");
+	if (check_translations && mode != tape_mode::unbounded)
+		throw std::runtime_error("Translated cycle detection needs an unbounded tape");
+
+	if (program.empty())
+		throw std::runtime_error("Program empty!");
+
+	for (const std::string &input : inputs)
+		for (char c : input)
+			check_tape_symbol(c);
+
+	build_table();
+
+	batch_runner runner(table, mode, get_tape_length(), initial_symbol, head_pos, INIT_STATE);
+	runner.set_cycle_check(check_cycles);
+	runner.set_translation_check(check_translations);
+	return runner.run(inputs, max_steps, window, threads, interrupt);
+}
+
+run_status turing_machine::run_batch(long n)
+{
+	build_table();
+	rle.reset();
+
+	run_status status;
+	uint32_t state = current_state;
+	long done;
+
+	if (tape_count > 1) {
+		tape_storage *tapes[tuple_table::MAX_TAPES];
+		long heads[tuple_table::MAX_TAPES];
+		for (int t = 0; t < tape_count; t++) {
+			tapes[t] = &get_tape_storage(t);
+			heads[t] = get_head_pos(t);
+		}
+		done = tuples.run_segments(tapes, heads, state, n, status);
+		head_pos = heads[0];
+		std::copy(heads + 1, heads + tape_count, extra_heads.begin());
+		computation_steps += done;
+		current_state = state;
+		if (status != run_status::step_limit)
+			is_halt = true;
+		return status;
 	}
 
-	// transition to next state
-	current_state = next.to_state;
+	if (prof) {
+		done = run_segments(profiling_engine{table, *prof, undo.get()}, *tape, head_pos, state, n, status);
+		computation_steps += done;
+		current_state = state;
+		if (undo)
+			undo->checkpoint(*tape, head_pos, state);
+		if (status != run_status::step_limit)
+			is_halt = true;
+		return status;
+	}
 
-	// check if halted
-	if (current_state == turing_machine::HALT_STATE) {
+	if (undo) {
+		done = run_segments(recording_engine{table, *undo}, *tape, head_pos, state, n, status);
+		computation_steps += done;
+		current_state = state;
+		undo->checkpoint(*tape, head_pos, state);
+		if (status != run_status::step_limit)
+			is_halt = true;
+		return status;
+	}
+
+	switch (engine) {
+		case engine_type::native:
+			done = run_segments(*native, *tape, head_pos, state, n, status);
+			break;
+		case engine_type::threaded:
+			done = run_segments(*threaded, *tape, head_pos, state, n, status);
+			break;
+		default:
+			done = run_segments(table, *tape, head_pos, state, n, status);
+			break;
+	}
+
+	computation_steps += done;
+	current_state = state;
+	if (status != run_status::step_limit)
 		is_halt = true;
-		return false;
+
+	return status;
+}
+
+run_status turing_machine::run_rle(long max_steps, const std::atomic<bool> *interrupt)
+{
+	build_table();
+
+	if (!rle)
+		rle.reset(new rle_tape(*tape, head_pos, mode != tape_mode::unbounded));
+	run_status status = run_status::step_limit;
+	uint32_t state = current_state;
+	long steps = 0;
+	long iterations = 0;
+
+	while (max_steps < 0 || steps < max_steps) {
+		if (rle->is_outside()) {
+			status = run_status::out_of_memory;
+			break;
+		}
+
+		transition_table::cell next = table.get_cell(state, rle->read());
+		if (!transition_table::is_defined(next)) {
+			steps++;
+			status = run_status::illegal_instruction;
+			break;
+		}
+
+		char write = transition_table::write_symbol(next);
+		int delta = transition_table::head_delta(next);
+		if (transition_table::next_state(next) == state && !transition_table::is_stop(next)) {
+			// self loop on the symbol read: cross the whole run at once
+			steps += rle->sweep(write, delta, max_steps < 0 ? LONG_MAX : max_steps - steps);
+			if (rle->is_outside()) {
+				status = run_status::out_of_memory;
+				break;
+			}
+		} else {
+			rle->step(write, delta);
+			steps++;
+			// off the tape the machine stays in the state it was
+			if (rle->is_outside()) {
+				status = run_status::out_of_memory;
+				break;
+			}
+			state = transition_table::next_state(next);
+			if (transition_table::is_stop(next)) {
+				status = run_status::halted;
+				break;
+			}
+		}
+
+		if (++iterations % INTERRUPT_CHECK_INTERVAL == 0 && interrupt != nullptr && interrupt->load(std::memory_order_relaxed)) {
+			status = run_status::interrupted;
+			break;
+		}
 	}
-	
-	return true;
+
+	rle->write_back(*tape);
+	head_pos = rle->get_head();
+	if (rle->is_outside())
+		rle.reset();
+
+	// an unbounded tape stores the head cell, as after running on the table
+	tape_segment seg;
+	tape->acquire(head_pos, seg);
+	computation_steps += steps;
+	current_state = state;
+	if (status != run_status::step_limit && status != run_status::interrupted)
+		is_halt = true;
+
+	return status;
 }
 
 void turing_machine::move_head(int diff) 
 {
-	if (head_pos + diff >= 0 && head_pos + diff < get_tape_length())	
+	if (tape->in_bounds(head_pos + diff))	
 		head_pos += diff;
 	else 
 		throw std::runtime_error("Head out of bounds");
+	forget_history();
 }
 
 // state getters
-const std::string& turing_machine::get_tape_raw() const 
+const std::string turing_machine::get_tape_range(long begin, long end, int t) const 
+{
+	return get_tape_storage(t).read(begin, end);
+}
+
+char turing_machine::get_tape_symbol(long pos, int t) const
+{
+	return get_tape_storage(t).get(pos);
+}
+
+long turing_machine::get_tape_begin(int t) const
+{
+	return get_tape_storage(t).get_begin();
+}
+
+long turing_machine::get_tape_length(int t) const 
+{
+	return get_tape_storage(t).get_length();
+}
+
+tape_mode turing_machine::get_tape_mode() const
+{
+	return mode;
+}
+
+engine_type turing_machine::get_engine() const
 {
-	return tape;
+	return engine;
 }
 
-long turing_machine::get_tape_length() const 
+int turing_machine::get_tape_count() const
 {
-	return tape.size();
+	return tape_count;
 }
 
-long turing_machine::get_head_pos() const 
+long turing_machine::get_head_pos(int t) const 
 {
-	return head_pos;
+	get_tape_storage(t);
+	return t == 0 ? head_pos : extra_heads[t - 1];
 }
 
 const std::string& turing_machine::get_current_state() const 
@@ -193,43 +766,63 @@ const std::string& turing_machine::get_current_state() const
 	return state_name[current_state];
 }
 
-int turing_machine::get_computation_steps() const 
+long turing_machine::get_computation_steps() const 
 {
 	return computation_steps;
 }
 
-const std::string turing_machine::get_tape(int n) const 
+long turing_machine::get_cycle_entry() const
+{
+	return cycle_entry;
+}
+
+long turing_machine::get_cycle_length() const
+{
+	return cycle_length;
+}
+
+long turing_machine::get_cycle_shift() const
+{
+	return cycle_shift;
+}
+
+const std::string turing_machine::get_tape(int n, int t) const 
 {
+	const tape_storage &storage = get_tape_storage(t);
+	long head = get_head_pos(t);
+	long begin = storage.get_begin();
+	long end = storage.get_end();
+
 	if (n == -1) {
-		if (head_pos >= 0 && head_pos < get_tape_length()) {
-			return tape.substr(0, head_pos)
-				+ '<' + tape[head_pos] + '>'
-				+ tape.substr(head_pos+1, tape.size()-head_pos-1);
+		if (head >= begin && head < end) {
+			return storage.read(begin, head)
+				+ '<' + storage.get(head) + '>'
+				+ storage.read(head+1, end);
 		}
-		if (head_pos < 0) {
-			return std::string("<>") + tape;
+		if (head < begin) {
+			return std::string("<>") + storage.read(begin, end);
 		} else {
-			return tape + "<>";
+			return storage.read(begin, end) + "<>";
 		}
 	}
 
-	int min = head_pos - n;
-	int max = head_pos + n;
+	long min = head - n;
+	long max = head + n;
 	std::string result = "";
 
-	if (min < 0)
-		min = 0; 
-	if (max > get_tape_length())
-		max = get_tape_length();
+	if (min < begin)
+		min = begin; 
+	if (max > end)
+		max = end;
 
-	if (head_pos > 0)
-		result += std::to_string(min) + "x[...]" + tape.substr(min, head_pos-min);
+	if (head > begin)
+		result += std::to_string(min - begin) + "x[...]" + storage.read(min, head);
 	result += "<";
-	if (head_pos >= 0 && head_pos < get_tape_length())
-		result += tape[head_pos];
+	if (head >= begin && head < end)
+		result += storage.get(head);
 	result += ">";
-	if (head_pos < get_tape_length() - 1)
-		result += tape.substr(head_pos+1, max-head_pos) + "[...]x" + std::to_string(get_tape_length()-max);
+	if (head < end - 1)
+		result += storage.read(head+1, std::min(max+1, end)) + "[...]x" + std::to_string(end-max);
 
 	return result;
 }
@@ -237,9 +830,19 @@ const std::string turing_machine::get_tape(int n) const
 const std::string turing_machine::get_state(int n) const 
 {
 	std::string res = "Current state: " + get_state_name(current_state) + "\n";
-	res += "Head position: " + std::to_string(head_pos) + "\n";
-	res += "Computation steps: " + std::to_string(computation_steps) + "\n";
-	res += "Tape state: " + get_tape(n) + "\n";
+	if (tape_count == 1) {
+		res += "Head position: " + std::to_string(head_pos) + "\n";
+		res += "Computation steps: " + std::to_string(computation_steps) + "\n";
+		res += "Tape state: " + get_tape(n) + "\n";
+		return res;
+	}
+
+	res += "Head positions: ";
+	for (int t = 0; t < tape_count; t++)
+		res += (t > 0 ? ", " : "") + std::to_string(get_head_pos(t));
+	res += "\nComputation steps: " + std::to_string(computation_steps) + "\n";
+	for (int t = 0; t < tape_count; t++)
+		res += "Tape " + std::to_string(t + 1) + " state: " + get_tape(n, t) + "\n";
 	return res;
 }
 
@@ -262,30 +865,201 @@ const std::string turing_machine::format_instruction(const instruction &i, int l
 	result += ", ";
 	result += (i.tape_direction == direction::L ? '<' : '>');
 	result += ")";
-	if (current_state == i.from_state && (tape[head_pos] == i.symbol_read || i.symbol_read == '-'))
-		result += " <- ";
-	result += "\n";
 	return result;
 }
 
+const std::string turing_machine::format_instruction(const tuple_instruction &i, int line) const 
+{
+	char num[10];
+	snprintf(num, sizeof(num), "%4d", line);
+	std::string result = std::string(num) + ": ";
+	if (i.from_state == INIT_STATE)
+		result += " ===> ";
+	else if (i.to_state == HALT_STATE) 
+		result += " HALT ";
+	else 
+		result += "      ";	
+	result += "(" + get_state_name(i.from_state) + ", " + i.symbols_read + ") -> (";
+	result += get_state_name(i.to_state) + ", " + i.symbols_write + ", " + i.moves + ")";
+	return result;
+}
+
+const std::string turing_machine::format_line(size_t index) const
+{
+	return tape_count > 1 ? format_instruction(tuple_program[index], index + 1)
+		: format_instruction(program[index], index + 1);
+}
+
+std::string turing_machine::get_symbols_read() const
+{
+	std::string read;
+	for (int t = 0; t < tape_count; t++)
+		read += get_tape_symbol(get_head_pos(t), t);
+	return read;
+}
+
+bool turing_machine::is_current(const instruction &i, const std::string &read) const
+{
+	return current_state == i.from_state && (read[0] == i.symbol_read || i.symbol_read == '-');
+}
+
+bool turing_machine::is_current(const tuple_instruction &i, const std::string &read) const
+{
+	if (current_state != i.from_state)
+		return false;
+	for (size_t t = 0; t < read.size(); t++)
+		if (read[t] != i.symbols_read[t] && i.symbols_read[t] != '-')
+			return false;
+	return true;
+}
+
 const std::string turing_machine::get_program() const 
 {
 	std::string result = "";
 
-	int l = 0;
-	for (const instruction &i : program) {
-		result += format_instruction(i, ++l);
+	std::string read = get_symbols_read();
+	for (size_t i = 0; i < get_program_size(); i++) {
+		result += format_line(i);
+		if (tape_count > 1 ? is_current(tuple_program[i], read) : is_current(program[i], read))
+			result += " <- ";
+		result += "\n";
 	}
 
 	return result;
 }
 
-const std::vector<std::string> turing_machine::get_program_lines() const 
+static std::string format_hits(uint64_t hits, uint64_t total)
 {
-	std::vector<std::string> result;
+	char buffer[48];
+	snprintf(buffer, sizeof(buffer), "%14llu %7.2f%%  ", static_cast<unsigned long long>(hits),
+		total != 0 ? 100.0 * hits / total : 0.0);
+	return buffer;
+}
+
+static std::string csv_field(const std::string &field)
+{
+	if (field.find_first_of(",\"\n") == std::string::npos)
+		return field;
+	std::string result = "\"";
+	for (char c : field) {
+		if (c == '"')
+			result += '"';
+		result += c;
+	}
+	return result + "\"";
+}
+
+const std::string turing_machine::get_profile(size_t top)
+{
+	if (!prof)
+		throw std::runtime_error("Profiling disabled");
+	build_table();
+
+	std::vector<profiler::entry> entries = prof->get_entries(table, program);
+	uint64_t total = prof->get_steps();
+
+	// the cells of a wildcard instruction add up on its line, the undefined
+	// transitions are listed one by one
+	std::vector<uint64_t> line_hits(program.size() + 1, 0);
+	std::vector<profiler::entry> hot;
+	std::unordered_map<uint32_t, uint64_t> state_hits;
+	uint64_t symbol_hits[transition_table::SYMBOLS] = {};
+	uint64_t other_hits = 0;
+	for (const profiler::entry &e : entries) {
+		if (e.line == 0 || line_hits[e.line] == 0)
+			hot.push_back(e);
+		if (e.line != 0)
+			line_hits[e.line] += e.hits;
+		state_hits[e.state] += e.hits;
+		if (e.other)
+			other_hits += e.hits;
+		else
+			symbol_hits[static_cast<unsigned char>(e.symbol)] += e.hits;
+	}
+	for (profiler::entry &e : hot)
+		if (e.line != 0)
+			e.hits = line_hits[e.line];
+	std::stable_sort(hot.begin(), hot.end(), [](const profiler::entry &a, const profiler::entry &b) {
+		return a.hits > b.hits;
+	});
+
+	std::string result = "Profiled steps: " + std::to_string(total);
+	result += ", head reversals: " + std::to_string(prof->get_reversals()) + "\n";
+
+	result += "Hot transitions:\n          hits        %  instruction\n";
+	for (size_t i = 0; i < hot.size() && i < top; i++) {
+		const profiler::entry &e = hot[i];
+		result += format_hits(e.hits, total);
+		if (e.line != 0)
+			result += format_instruction(program[e.line - 1], e.line);
+		else
+			result += "      undefined (" + get_state_name(e.state) + ", "
+				+ (e.other ? std::string("other") : std::string(1, e.symbol)) + ")";
+		result += "\n";
+	}
+
+	std::vector<std::pair<uint64_t, uint32_t>> states;
+	for (const auto &h : state_hits)
+		states.push_back({ h.second, h.first });
+	std::sort(states.begin(), states.end(), [](const std::pair<uint64_t, uint32_t> &a,
+		const std::pair<uint64_t, uint32_t> &b) {
+		return a.first != b.first ? a.first > b.first : a.second < b.second;
+	});
+	result += "States:\n          hits        %  state\n";
+	for (size_t i = 0; i < states.size() && i < top; i++)
+		result += format_hits(states[i].first, total) + get_state_name(states[i].second) + "\n";
+
+	result += "Symbols read:\n          hits        %  symbol\n";
+	for (int c = 0; c < transition_table::SYMBOLS; c++) {
+		if (symbol_hits[c] == 0)
+			continue;
+		result += format_hits(symbol_hits[c], total) + static_cast<char>(c) + "\n";
+	}
+	if (other_hits != 0)
+		result += format_hits(other_hits, total) + "other\n";
 
-	for (size_t i = 0; i < program.size(); i++) {
-		result.push_back(format_instruction(program[i], i+1));
+	return result;
+}
+
+const std::string turing_machine::get_profile_csv()
+{
+	if (!prof)
+		throw std::runtime_error("Profiling disabled");
+	build_table();
+
+	std::string result = "kind,line,state,symbol,hits\n";
+	result += "steps,,,," + std::to_string(prof->get_steps()) + "\n";
+	result += "reversals,,,," + std::to_string(prof->get_reversals()) + "\n";
+	for (const profiler::entry &e : prof->get_entries(table, program)) {
+		result += e.line != 0 ? "transition," + std::to_string(e.line) : std::string("undefined,");
+		result += "," + csv_field(get_state_name(e.state)) + ","
+			+ csv_field(e.other ? std::string("other") : std::string(1, e.symbol));
+		result += "," + std::to_string(e.hits) + "\n";
+	}
+	return result;
+}
+
+size_t turing_machine::get_program_size() const
+{
+	return tape_count > 1 ? tuple_program.size() : program.size();
+}
+
+const std::vector<std::string> turing_machine::get_program_lines(size_t first, size_t count) const 
+{
+	size_t size = get_program_size();
+	if (program_lines.size() != size) {
+		program_lines.clear();
+		program_lines.reserve(size);
+		for (size_t i = 0; i < size; i++)
+			program_lines.push_back(format_line(i));
+	}
+
+	std::vector<std::string> result;
+	std::string read = get_symbols_read();
+	for (size_t i = first; i < size && i - first < count; i++) {
+		result.push_back(program_lines[i]);
+		if (tape_count > 1 ? is_current(tuple_program[i], read) : is_current(program[i], read))
+			result.back() += " <- ";
 	}
 
 	return result;
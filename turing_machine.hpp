@@ -1,12 +1,28 @@
 #ifndef TURING_MACHINE_H
 #define TURING_MACHINE_H
 
+#include <atomic>
 #include <string>
 #include <vector>
-#include <array>
-#include <map>
+#include <unordered_map>
+#include <memory>
 
-enum class direction {L, R};
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+#include "native_program.hpp"
+#include "threaded_program.hpp"
+#include "batch_runner.hpp"
+#include "cycle_detector.hpp"
+#include "translation_detector.hpp"
+#include "undo_log.hpp"
+#include "profiler.hpp"
+#include "tuple_table.hpp"
+#include "rle_tape.hpp"
+
+// algorithm used by run() to execute the machine
+enum class engine_type {table, threaded, rle, native};
+
+const char *to_string(engine_type engine);
 
 class turing_machine {
 
@@ -14,73 +30,163 @@ class turing_machine {
 	static const int INIT_STATE; 
 	static const char * halt_state_name;
 	static const char * init_state_name;
+	static const long INTERRUPT_CHECK_INTERVAL;
 
-	struct instruction {
-		bool is_valid;
-		int from_state;
-		char symbol_read;
-		int to_state;
-		char symbol_write;
-		direction tape_direction;
-	};
-	
 	// machine variables
-	std::string tape;
+	std::unique_ptr<tape_storage> tape;
+	tape_mode mode;
 	long head_pos;
 	char initial_symbol;
 	int current_state;
-	int computation_steps;
+	long computation_steps;
 	bool is_halt;
+	long cycle_entry = -1;
+	long cycle_length = -1;
+	long cycle_shift = 0;
+
+	// tapes after the first one of a multi-tape machine and their heads
+	int tape_count = 1;
+	std::vector<std::unique_ptr<tape_storage>> extra_tapes;
+	std::vector<long> extra_heads;
 
 	// machine instructions
 	std::vector<instruction> program;
-	std::vector<std::array<instruction, 128> > table; 
+	transition_table table;
+	// the program of a multi-tape machine, the single tape one stays empty
+	std::vector<tuple_instruction> tuple_program;
+	tuple_table tuples;
+	bool table_dirty = true;
+	// formatted program lines without the current marker, rebuilt when
+	// cleared on a change of the program
+	mutable std::vector<std::string> program_lines;
+	engine_type engine = engine_type::table;
+	std::unique_ptr<native_program> native;
+	std::unique_ptr<threaded_program> threaded;
+	std::unique_ptr<undo_log> undo;
+	std::unique_ptr<profiler> prof;
+	// encoding of the tape kept by the rle engine between runs, dropped when
+	// the tape or the head change in any other way
+	std::unique_ptr<rle_tape> rle;
 
 	// state codification variables
 	std::vector<std::string> state_name = {halt_state_name, init_state_name};
-	std::map<std::string, int> state_code = {
+	std::unordered_map<std::string, int> state_code = {
 		{halt_state_name, HALT_STATE}, 
 		{init_state_name, INIT_STATE}
 	};
 
 	// state codifications functions
 	int get_state_code(const std::string& name);
-	std::string get_state_name(int code) const;
 	const std::string format_instruction(const instruction& i, int line) const;
+	const std::string format_instruction(const tuple_instruction& i, int line) const;
+	// symbols under the heads, one per tape
+	std::string get_symbols_read() const;
+	bool is_current(const instruction& i, const std::string& read) const;
+	bool is_current(const tuple_instruction& i, const std::string& read) const;
+	const std::string format_line(size_t index) const;
+	std::string get_alphabet() const;
+	void build_table();
+	void forget_history();
+	tape_storage& get_tape_storage(int tape) const;
+	void create_extra_tapes();
+	void check_single_tape(const char *feature) const;
+
+	// executes at most n steps without any exception or interruption check
+	run_status run_batch(long n);
+	run_status run_rle(long max_steps, const std::atomic<bool> *interrupt);
+	template <typename Detector>
+	run_status run_detector(Detector& detector, long max_steps, const std::atomic<bool> *interrupt);
 
 public:
 	turing_machine(long memory_size = 1000, char initial_symbol = '0');
 
 	// program manipulation instructions
 	void add_instruction(const std::string& from, char read, const std::string& to, char write, direction dir);
+	// instruction of a multi-tape machine, one symbol read, written and move per tape
+	void add_instruction(const std::string& from, const std::string& read, const std::string& to,
+		const std::string& write, const std::string& moves);
 	void del_instruction(int index);
 	void clear_program();
 	
 	// machine settings
 	void set_memory_size(long memory_size);
+	void set_tape_mode(tape_mode mode);
+	// machine with `count` tapes and heads, clears the program
+	void set_tape_count(int count);
+	void set_engine(engine_type engine);
+	// records the last `capacity` steps to run backwards, 0 disables it
+	void set_undo_log(size_t capacity);
+	// counts the steps taken through every transition, see get_profile
+	void set_profiling(bool enabled);
+	void clear_profile();
+	const native_program& compile_native();
 	void set_initial_symbol(char init);
-	void set_head_position(long pos) ;
-	void set_tape(long pos, const std::string& str);
+	void set_head_position(long pos, int tape = 0);
+	void set_tape(long pos, const std::string& str, int tape = 0);
 	void set_tape(long pos, char c);
 	void set_state(const std::string& state);
 
 	// machine control 
 	void reset();
 	bool step();
+	void back(long n = 1);
+	// throws the errors step gives on a halted machine or an empty program,
+	// for the callers of the run functions, which return halted or
+	// illegal_instruction in those cases
+	void check_runnable() const;
+	run_status run(long max_steps = -1, const std::atomic<bool> *interrupt = nullptr);
+	run_status step_n(long n, const std::atomic<bool> *interrupt = nullptr);
+	run_status run_macro(int block_size, long max_steps = -1, const std::atomic<bool> *interrupt = nullptr);
+	// like run, stops with run_status::cycling when the configuration repeats,
+	// and with run_status::translated like run_translation_check when asked to
+	run_status run_cycle_check(long max_steps = -1, const std::atomic<bool> *interrupt = nullptr,
+		bool check_translations = false);
+	// like run, stops with run_status::translated when the machine is proven
+	// to repeat itself while drifting over the blank tape
+	run_status run_translation_check(long max_steps = -1, const std::atomic<bool> *interrupt = nullptr);
 	void move_head(int diff);
 
-	// state getters
-	const std::string& get_tape_raw() const;
-	long get_tape_length() const;
-	long get_head_pos() const;
+	// runs the program from the initial state on every input written at the
+	// head position, on private tapes shared among `threads` workers
+	std::vector<batch_result> run_inputs(const std::vector<std::string>& inputs, long max_steps, int window,
+		bool check_cycles = false, bool check_translations = false, unsigned threads = 0,
+		const std::atomic<bool> *interrupt = nullptr);
+
+	// state getters, the tapes are numbered from 0
+	const std::string get_tape_range(long begin, long end, int tape = 0) const;
+	char get_tape_symbol(long pos, int tape = 0) const;
+	long get_tape_begin(int tape = 0) const;
+	long get_tape_length(int tape = 0) const;
+	tape_mode get_tape_mode() const;
+	engine_type get_engine() const;
+	int get_tape_count() const;
+	long get_head_pos(int tape = 0) const;
 	const std::string& get_current_state() const; 
-	int get_computation_steps() const;
-	const std::vector<std::string> get_program_lines() const;
-	const std::string get_tape(int n = -1) const;
+	std::string get_state_name(int code) const;
+	long get_computation_steps() const;
+	long get_cycle_entry() const;
+	long get_cycle_length() const;
+	long get_cycle_shift() const;
+	size_t get_program_size() const;
+	// lines [first, first + count) of the program, the current instructions marked
+	const std::vector<std::string> get_program_lines(size_t first, size_t count) const;
+	const std::string get_tape(int n = -1, int tape = 0) const;
 	const std::string get_state(int n = -1) const;
 	const std::string get_program() const;
+	// the `top` hottest instructions and the hits per state and symbol read
+	const std::string get_profile(size_t top);
+	// one line per transition taken: kind,line,state,symbol,hits
+	const std::string get_profile_csv();
 
 	friend void save_file(const std::string& filename, const turing_machine& tm);
+	friend class program_loader;
+	friend void save_checkpoint(const std::string& filename, const turing_machine& tm);
+	friend void restore_checkpoint(const std::string& filename, turing_machine& tm);
+	friend void save_binary_program(const std::string& filename, const turing_machine& tm, uint64_t source_hash,
+		unsigned settings);
+	friend void load_program_image(const std::shared_ptr<class program_image>& image, const std::string& filename,
+		turing_machine& tm);
+	friend bool load_program_cache(const std::string& source, turing_machine& tm);
 };
 
 #endif
@@ -0,0 +1,148 @@
+#include "undo_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const long undo_log::SNAPSHOT_INTERVAL = 1 << 20;
+const size_t undo_log::MAX_SNAPSHOTS = 16;
+// larger tapes are not snapshotted, only the ring can bring them back
+const long undo_log::SNAPSHOT_MAX_CELLS = 1 << 24;
+
+undo_log::undo_log(size_t capacity)
+	: ring(std::max<size_t>(capacity, 1))
+{
+}
+
+long undo_log::record(const transition_table &table, char *tape, long &head, uint32_t &state, long n,
+	run_status &status)
+{
+	size_t capacity = ring.size();
+	long h = head;
+	uint32_t s = state;
+	long done = 0;
+
+	status = run_status::step_limit;
+	while (done < n) {
+		char c = tape[h];
+		transition_table::cell next = table.get_cell(s, c);
+		int delta = transition_table::head_delta(next);
+
+		ring[next_slot] = static_cast<entry>(c) | static_cast<entry>(delta + 1) << 7 | s << 9;
+		next_slot = next_slot + 1 == capacity ? 0 : next_slot + 1;
+		done++;
+
+		tape[h] = transition_table::write_symbol(next);
+		h += delta;
+		s = transition_table::next_state(next);
+		if (transition_table::is_stop(next)) {
+			status = transition_table::is_defined(next) ? run_status::halted : run_status::illegal_instruction;
+			break;
+		}
+	}
+
+	count = std::min(capacity, count + done);
+	steps += done;
+	head = h;
+	state = s;
+	return done;
+}
+
+void undo_log::clear(long s)
+{
+	next_slot = 0;
+	count = 0;
+	steps = s;
+	snapshots.clear();
+	last_snapshot = s;
+}
+
+void undo_log::checkpoint(const tape_storage &tape, long head, uint32_t state)
+{
+	if (steps - last_snapshot < SNAPSHOT_INTERVAL)
+		return;
+	if (tape.get_length() > SNAPSHOT_MAX_CELLS)
+		return;
+
+	if (snapshots.size() == MAX_SNAPSHOTS)
+		snapshots.erase(snapshots.begin());
+	snapshots.push_back({ steps, head, state, tape.get_begin(), tape.read(tape.get_begin(), tape.get_end()) });
+	last_snapshot = steps;
+}
+
+void undo_log::restore(const snapshot &s, tape_storage &tape, long &head, uint32_t &state) const
+{
+	// cells stored after the snapshot was taken were blank at that time
+	tape.clear(tape.get_blank());
+
+	long size = s.cells.size();
+	tape_segment seg;
+	for (long i = 0; i < size; ) {
+		long pos = s.begin + i;
+		tape.acquire(pos, seg);
+		long n = std::min(size - i, seg.end - pos);
+		std::memcpy(seg.cells + (pos - seg.begin), s.cells.data() + i, n);
+		i += n;
+	}
+
+	head = s.head;
+	state = s.state;
+}
+
+bool undo_log::back(const transition_table &table, long n, tape_storage &tape, long &head, uint32_t &state)
+{
+	long target = steps - n;
+	if (n < 0 || target < get_oldest())
+		return false;
+
+	const snapshot *from = nullptr;
+	for (const snapshot &s : snapshots)
+		if (s.steps <= target)
+			from = &s;
+
+	// undo entry by entry, unless replaying from a snapshot is shorter
+	if (target >= steps - static_cast<long>(count) && (from == nullptr || n <= target - from->steps)) {
+		size_t capacity = ring.size();
+		for (long i = 0; i < n; i++) {
+			next_slot = next_slot == 0 ? capacity - 1 : next_slot - 1;
+			entry e = ring[next_slot];
+			head -= static_cast<int>((e >> 7) & 3) - 1;
+			tape.set(head, static_cast<char>(e & 0x7f));
+			state = e >> 9;
+		}
+		count -= n;
+		steps = target;
+	} else {
+		restore(*from, tape, head, state);
+		run_status status;
+		run_segments(table, tape, head, state, target - from->steps, status);
+
+		// the newest entries are past the target now
+		long dropped = std::min(static_cast<long>(count), n);
+		next_slot = (next_slot + ring.size() - dropped) % ring.size();
+		count -= dropped;
+		steps = target;
+	}
+
+	while (!snapshots.empty() && snapshots.back().steps > target)
+		snapshots.pop_back();
+	last_snapshot = std::min(last_snapshot, target);
+	return true;
+}
+
+long undo_log::get_oldest() const
+{
+	long oldest = steps - count;
+	if (!snapshots.empty())
+		oldest = std::min(oldest, snapshots.front().steps);
+	return oldest;
+}
+
+long undo_log::get_steps() const
+{
+	return steps;
+}
+
+size_t undo_log::get_capacity() const
+{
+	return ring.size();
+}
@@ -0,0 +1,91 @@
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transition_table.hpp"
+#include "tape_storage.hpp"
+
+/*
+ * History of the last steps of a machine, to run it backwards. Every step is
+ * packed in a 32 bit entry of a ring buffer:
+ *
+ *   bits  0-6   symbol overwritten
+ *   bits  7-8   head delta + 1 (1 when the step didn't move)
+ *   bits  9-30  previous state
+ *
+ * Full snapshots of the tape are taken every SNAPSHOT_INTERVAL steps, counted
+ * from the last clear so that editing the machine stays cheap, so
+ * going back further than the ring remembers, or more steps than it takes
+ * to replay from a snapshot, restores a snapshot and runs forward.
+ */
+class undo_log {
+	static const long SNAPSHOT_INTERVAL;
+	static const size_t MAX_SNAPSHOTS;
+	static const long SNAPSHOT_MAX_CELLS;
+
+	typedef uint32_t entry;
+
+	struct snapshot {
+		long steps;
+		long head;
+		uint32_t state;
+		long begin;
+		std::string cells;
+	};
+
+	std::vector<entry> ring;
+	size_t next_slot = 0;	// slot of the next entry
+	size_t count = 0;	// entries in the ring
+	long steps = 0;		// steps of the machine after the newest entry
+	std::vector<snapshot> snapshots;
+	long last_snapshot = 0;	// steps of the newest snapshot, or of the clear
+
+	void restore(const snapshot& s, tape_storage& tape, long& head, uint32_t& state) const;
+
+public:
+	undo_log(size_t capacity);
+
+	// same contract as transition_table::execute, recording every step
+	long record(const transition_table& table, char *tape, long &head, uint32_t &state, long n, run_status &status);
+
+	// records a single step run by someone else: the symbol it overwrites,
+	// its head delta and the state it leaves
+	void push(char overwritten, int delta, uint32_t state)
+	{
+		ring[next_slot] = static_cast<entry>(overwritten) | static_cast<entry>(delta + 1) << 7 | state << 9;
+		next_slot = next_slot + 1 == ring.size() ? 0 : next_slot + 1;
+		count = std::min(ring.size(), count + 1);
+		steps++;
+	}
+
+	// forgets the history, the machine is now at the given step
+	void clear(long steps);
+
+	// takes a snapshot if one is due
+	void checkpoint(const tape_storage& tape, long head, uint32_t state);
+
+	// moves the machine n steps back, returns false if the history is too short
+	bool back(const transition_table& table, long n, tape_storage& tape, long& head, uint32_t& state);
+
+	// oldest step the machine can go back to
+	long get_oldest() const;
+	long get_steps() const;
+	size_t get_capacity() const;
+};
+
+// adapter to run a table through run_segments while recording the steps
+struct recording_engine {
+	const transition_table& table;
+	undo_log& log;
+
+	long execute(char *tape, long &head, uint32_t &state, long n, run_status &status) const
+	{
+		return log.record(table, tape, head, state, n, status);
+	}
+};
+
+#endif